@@ -0,0 +1,610 @@
+/* membench.c : replay allocation traces against a kernel allocator
+ *
+ * Built by bench/Makefile once for each kernel's c/mem.c, so the
+ * allocators can be compared on Linux without booting them. Memory is
+ * laid out as the kernels see it in Bochs: the allocator manages from
+ * the end of the kernel to HOLESTART and from HOLEEND to the top of
+ * memory. The hole is mapped read only, so an allocator that hands it
+ * out or writes into it crashes the benchmark.
+ *
+ * A trace is a list of operations, one per line:
+ *
+ *     a <id> <size>       kmalloc size bytes, known as id from now on
+ *     f <id>              kfree the allocation known as id
+ *
+ * Blank lines and lines starting with # are ignored. Without -f a
+ * synthetic trace is generated; the same profile, length and seed give
+ * the same trace on every allocator.
+ *
+ * For each trace it reports
+ *   - ns per operation, the best of several timed replays
+ *   - peak live bytes and peak footprint, the bytes from the start of
+ *     memory to the end of the highest block in use, not counting the
+ *     hole. Fragmentation is the share of the peak footprint that was
+ *     not live at the peak.
+ *   - how many kmallocs failed, and the operation and live bytes at the
+ *     first failure
+ *   - the operation the allocator crashed on, if it corrupts its lists
+ *
+ * Usage: membench_a? [-p small|mixed|large] [-n ops] [-s seed]
+ *                    [-f trace] [-w trace] [-r runs] [-m megs] [-v]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* The memory layout of the kernels, as in h/i386.h */
+#define HOLESTART       (640 * 1024)
+#define HOLEEND         ((1024 + 600) * 1024)
+
+/* Lowest mapped address, and where the kernel image ends */
+#define MEM_BASE        0x10000
+#define KERNEL_END      0x20000
+
+/* Mapped past the top of memory, the a1/a2 kfree looks at the word */
+/* after a block to see if it can coalesce                          */
+#define GUARD           4096
+
+#define OP_ALLOC        'a'
+#define OP_FREE         'f'
+
+
+/* What the allocator needs from the rest of the kernel */
+long            freemem;
+char            *maxaddr;
+unsigned long   ticks;
+
+/* The allocator under test */
+#ifdef MEM_RANGES
+typedef struct {
+    unsigned long       start;
+    unsigned long       end;
+} memrange;
+
+void    kmeminit( memrange *ranges, int nranges );
+#else
+void    kmeminit( void );
+#endif
+void    *kmalloc( unsigned int size );
+void    kfree( void *ptr );
+
+
+typedef struct {
+    char                kind;
+    int                 id;
+    unsigned int        size;
+} op;
+
+typedef struct {
+    const char          *name;
+    unsigned int        lo, hi;         /* Sizes, log uniform within      */
+    unsigned int        bigLo, bigHi;   /* ... or these, 1 in bigOdds     */
+    int                 bigOdds;
+    unsigned long       target;         /* Live bytes the trace hovers at */
+} profile;
+
+static const profile profiles[] = {
+    { "small",  8,      256,            0,      0,              0,
+      512 * 1024 },
+    { "mixed",  16,     512,            512,    64 * 1024,      8,
+      1536 * 1024 },
+    { "large",  4096,   128 * 1024,     0,      0,              0,
+      2560 * 1024 },
+};
+
+typedef struct {
+    long                allocs;
+    long                failures;
+    long                firstFailure;   /* Index of the op, -1 if none    */
+    unsigned long       liveAtFailure;
+    unsigned long       peakLive;
+    unsigned long       peakSpan;
+    unsigned long       liveAtSpan;     /* Live bytes at the peak span    */
+} result;
+
+static op               *ops;
+static int              nops, maxops;
+static int              maxid;
+static void             **ptrs;
+static unsigned int     *sizes;
+static unsigned long    memTop;
+static int              verbose;
+static int              messages;
+static unsigned int     seed = 1;
+static const char       *name;
+static volatile int     current = -1;   /* Op being replayed, for crashes */
+
+
+/* Internal Helpers */
+static void             map_memory( unsigned long megs );
+static void             reset_memory( void );
+static void             add_op( char kind, int id, unsigned int size );
+static void             load_trace( const char *file );
+static void             save_trace( const char *file );
+static void             synth_trace( const profile *pr, int n );
+static unsigned int     pick_size( unsigned int lo, unsigned int hi );
+static unsigned int     rnd( void );
+static void             replay( result *r );
+static double           time_replay( void );
+static unsigned long    span( void *p, unsigned int size );
+static double           now( void );
+static void             crashed( int sig );
+
+
+int main( int argc, char **argv ) {
+
+    const profile       *pr = &profiles[1];
+    const char          *in = NULL, *out = NULL;
+    int                 i, n = 200000, runs = 5;
+    unsigned long       megs = 4;
+    double              best, t;
+    result              r;
+
+    for( i = 1; i < argc; i++ ) {
+        if( !strcmp( argv[i], "-v" ) ) {
+            verbose = 1;
+            continue;
+        }
+        if( i + 1 == argc || argv[i][0] != '-' ) {
+            goto usage;
+        }
+        switch( argv[i++][1] ) {
+        case 'p':
+            for( pr = profiles; strcmp( pr->name, argv[i] ); pr++ ) {
+                if( pr == &profiles[2] ) {
+                    goto usage;
+                }
+            }
+            break;
+        case 'n': n = atoi( argv[i] ); break;
+        case 's': seed = strtoul( argv[i], NULL, 0 ); break;
+        case 'f': in = argv[i]; break;
+        case 'w': out = argv[i]; break;
+        case 'r': runs = atoi( argv[i] ); break;
+        case 'm': megs = strtoul( argv[i], NULL, 0 ); break;
+        default: goto usage;
+        }
+    }
+
+    if( n <= 0 || runs <= 0 || megs * 1024 * 1024 <= HOLEEND ) {
+        goto usage;
+    }
+
+    if( in ) {
+        load_trace( in );
+    } else {
+        synth_trace( pr, n );
+    }
+    if( out ) {
+        save_trace( out );
+    }
+
+    ptrs = calloc( maxid + 1, sizeof( void * ) );
+    sizes = calloc( maxid + 1, sizeof( unsigned int ) );
+    if( !ptrs || !sizes ) {
+        fprintf( stderr, "out of memory for %d ids\n", maxid + 1 );
+        return 1;
+    }
+
+    name = strrchr( argv[0], '/' ) ? strrchr( argv[0], '/' ) + 1 : argv[0];
+
+    map_memory( megs );
+
+    signal( SIGSEGV, crashed );
+    signal( SIGBUS, crashed );
+    replay( &r );
+    current = -1;
+
+    best = 0;
+    for( i = 0; i < runs; i++ ) {
+        t = time_replay();
+        if( !i || t < best ) {
+            best = t;
+        }
+    }
+    current = -1;
+
+    printf( "%s %s: %d ops, %ld allocs, %ld failed",
+            name, in ? in : pr->name, nops, r.allocs, r.failures );
+    if( r.failures ) {
+        printf( " (first at op %ld with %lu bytes live)",
+                r.firstFailure, r.liveAtFailure );
+    }
+    printf( "\n  %.1f ns/op (best of %d)  peak live %lu  "
+            "peak footprint %lu  fragmentation %.1f%%\n",
+            best * 1e9 / nops, runs, r.peakLive, r.peakSpan,
+            r.peakSpan ? 100.0 * ( r.peakSpan - r.liveAtSpan ) / r.peakSpan
+                       : 0.0 );
+    if( messages && !verbose ) {
+        printf( "  %d allocator messages, -v to see them\n", messages );
+    }
+
+    return 0;
+
+usage:
+    fprintf( stderr, "usage: %s [-p small|mixed|large] [-n ops] [-s seed]\n"
+             "           [-f trace] [-w trace] [-r runs] [-m megs] [-v]\n",
+             argv[0] );
+    return 2;
+}
+
+/* The allocators report errors with kprintf */
+int kprintf( char *fmt, ... ) {
+
+    va_list             ap;
+
+    messages++;
+    if( verbose ) {
+        va_start( ap, fmt );
+        vprintf( fmt, ap );
+        va_end( ap );
+        putchar( '\n' );
+    }
+
+    return 0;
+}
+
+/* Used by krealloc in a3 */
+void blkcopy( void *dst, void *src, int n ) {
+    memmove( dst, src, n );
+}
+
+/* Used by setmemlimit in a3, never called here */
+void *findPCB( int pid ) {
+    return NULL;
+}
+
+/* Used by getmeminfo and getmemtrace in a3, never called here */
+int user_range_ok( void *p, void *addr, unsigned long len ) {
+    return 0;
+}
+
+/*
+ * Maps memory at the addresses the kernels use, with the hole read only.
+ */
+static void map_memory( unsigned long megs ) {
+
+    struct {
+        unsigned long   start, end;
+        int             prot;
+    } m[3];
+    void                *a;
+    int                 i;
+
+    memTop = megs * 1024 * 1024;
+
+    m[0].start = MEM_BASE;
+    m[0].end = HOLESTART;
+    m[0].prot = PROT_READ | PROT_WRITE;
+    m[1].start = HOLESTART;
+    m[1].end = HOLEEND;
+    m[1].prot = PROT_READ;
+    m[2].start = HOLEEND;
+    m[2].end = memTop + GUARD;
+    m[2].prot = PROT_READ | PROT_WRITE;
+
+    for( i = 0; i < 3; i++ ) {
+        a = mmap( (void *)m[i].start, m[i].end - m[i].start, m[i].prot,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0 );
+        if( a != (void *)m[i].start ) {
+            fprintf( stderr, "cannot map %#lx-%#lx, is vm.mmap_min_addr "
+                     "above %#x?\n", m[i].start, m[i].end, MEM_BASE );
+            exit( 1 );
+        }
+    }
+
+    freemem = KERNEL_END;
+    maxaddr = (char *)( memTop - 1 );
+}
+
+/*
+ * Clears memory and starts the allocator over, so every replay sees
+ * the same memory.
+ */
+static void reset_memory( void ) {
+
+#ifdef MEM_RANGES
+    memrange            r = { 0, memTop };
+#endif
+
+    memset( (void *)KERNEL_END, 0, HOLESTART - KERNEL_END );
+    memset( (void *)HOLEEND, 0, memTop - HOLEEND );
+    memset( ptrs, 0, ( maxid + 1 ) * sizeof( void * ) );
+
+#ifdef MEM_RANGES
+    kmeminit( &r, 1 );
+#else
+    kmeminit();
+#endif
+}
+
+static void add_op( char kind, int id, unsigned int size ) {
+
+    if( nops == maxops ) {
+        maxops = maxops ? maxops * 2 : 4096;
+        ops = realloc( ops, maxops * sizeof( op ) );
+        if( !ops ) {
+            fprintf( stderr, "out of memory for %d ops\n", maxops );
+            exit( 1 );
+        }
+    }
+
+    ops[nops].kind = kind;
+    ops[nops].id = id;
+    ops[nops].size = size;
+    nops++;
+
+    if( id > maxid ) {
+        maxid = id;
+    }
+}
+
+static void load_trace( const char *file ) {
+
+    FILE                *f = fopen( file, "r" );
+    char                line[128], kind;
+    int                 id, line_no = 0;
+    unsigned int        size;
+
+    if( !f ) {
+        perror( file );
+        exit( 1 );
+    }
+
+    while( fgets( line, sizeof( line ), f ) ) {
+        line_no++;
+        if( line[0] == '#' || line[0] == '\n' ) {
+            continue;
+        }
+        size = 0;
+        if( sscanf( line, " %c %d %u", &kind, &id, &size ) < 2 || id < 0
+            || ( kind != OP_ALLOC && kind != OP_FREE ) ) {
+            fprintf( stderr, "%s:%d: bad operation\n", file, line_no );
+            exit( 1 );
+        }
+        add_op( kind, id, size );
+    }
+
+    fclose( f );
+}
+
+static void save_trace( const char *file ) {
+
+    FILE                *f = fopen( file, "w" );
+    int                 i;
+
+    if( !f ) {
+        perror( file );
+        exit( 1 );
+    }
+
+    fprintf( f, "# %d operations\n", nops );
+    for( i = 0; i < nops; i++ ) {
+        if( ops[i].kind == OP_ALLOC ) {
+            fprintf( f, "a %d %u\n", ops[i].id, ops[i].size );
+        } else {
+            fprintf( f, "f %d\n", ops[i].id );
+        }
+    }
+
+    fclose( f );
+}
+
+/*
+ * Generates n operations that grow the live set to the profile's target
+ * and then churn around it, freeing objects at random. Everything still
+ * live is freed at the end.
+ */
+static void synth_trace( const profile *pr, int n ) {
+
+    int                 *live = malloc( n * sizeof( int ) );
+    unsigned int        *size = malloc( n * sizeof( unsigned int ) );
+    unsigned long       bytes = 0;
+    int                 nlive = 0, next = 0, i, j, grow;
+
+    if( !live || !size ) {
+        fprintf( stderr, "out of memory for %d ops\n", n );
+        exit( 1 );
+    }
+
+    for( i = 0; i < n; i++ ) {
+        grow = rnd() % 10 < ( bytes < pr->target ? 6 : 4 );
+        if( !nlive || grow ) {
+            if( pr->bigOdds && rnd() % pr->bigOdds == 0 ) {
+                size[next] = pick_size( pr->bigLo, pr->bigHi );
+            } else {
+                size[next] = pick_size( pr->lo, pr->hi );
+            }
+            add_op( OP_ALLOC, next, size[next] );
+            bytes += size[next];
+            live[nlive++] = next++;
+        } else {
+            j = rnd() % nlive;
+            add_op( OP_FREE, live[j], 0 );
+            bytes -= size[live[j]];
+            live[j] = live[--nlive];
+        }
+    }
+
+    while( nlive ) {
+        add_op( OP_FREE, live[--nlive], 0 );
+    }
+
+    free( live );
+    free( size );
+}
+
+/*
+ * Picks a size between lo and hi, each power of two range as likely as
+ * the next, so small sizes are common and big ones rare.
+ */
+static unsigned int pick_size( unsigned int lo, unsigned int hi ) {
+
+    unsigned int        k, base, s;
+
+    for( k = 0; ( 2u << k ) <= lo; k++ );
+    base = 1u << k;
+    while( ( base << 1 ) < hi && rnd() % 2 ) {
+        base <<= 1;
+    }
+
+    s = base + rnd() % base;
+    return s < lo ? lo : s > hi ? hi : s;
+}
+
+/* xorshift, so traces are the same everywhere */
+static unsigned int rnd( void ) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/*
+ * Replays the trace once, checking every block handed out and keeping
+ * the statistics.
+ */
+static void replay( result *r ) {
+
+    unsigned long       live = 0, s;
+    unsigned char       *p;
+    int                 i, id;
+
+    memset( r, 0, sizeof( result ) );
+    r->firstFailure = -1;
+
+    reset_memory();
+
+    for( i = 0; i < nops; i++ ) {
+        id = ops[i].id;
+        current = i;
+        if( ops[i].kind == OP_FREE ) {
+            if( ptrs[id] ) {
+                kfree( ptrs[id] );
+                live -= sizes[id];
+                ptrs[id] = NULL;
+            }
+            continue;
+        }
+
+        if( ptrs[id] ) {
+            fprintf( stderr, "op %d: id %d allocated twice\n", i, id );
+            exit( 1 );
+        }
+
+        r->allocs++;
+        p = kmalloc( ops[i].size );
+        if( !p ) {
+            if( !r->failures++ ) {
+                r->firstFailure = i;
+                r->liveAtFailure = live;
+            }
+            continue;
+        }
+
+        if( (unsigned long)p < KERNEL_END
+            || (unsigned long)p + ops[i].size > memTop
+            || ( (unsigned long)p + ops[i].size > HOLESTART
+                 && (unsigned long)p < HOLEEND ) ) {
+            fprintf( stderr, "op %d: kmalloc(%u) returned %p, outside "
+                     "memory\n", i, ops[i].size, p );
+            exit( 1 );
+        }
+
+        // Scribble over the block so overlapping blocks corrupt the
+        // allocator's own headers and show up
+        memset( p, id, ops[i].size );
+
+        ptrs[id] = p;
+        sizes[id] = ops[i].size;
+        live += ops[i].size;
+
+        if( live > r->peakLive ) {
+            r->peakLive = live;
+        }
+        s = span( p, ops[i].size );
+        if( s > r->peakSpan ) {
+            r->peakSpan = s;
+            r->liveAtSpan = live;
+        }
+    }
+}
+
+/*
+ * Replays the trace with nothing but the allocator calls.
+ *
+ * Returns:
+ *   seconds taken
+ */
+static double time_replay( void ) {
+
+    double              start;
+    int                 i;
+
+    reset_memory();
+
+    start = now();
+    for( i = 0; i < nops; i++ ) {
+        current = i;
+        if( ops[i].kind == OP_ALLOC ) {
+            ptrs[ops[i].id] = kmalloc( ops[i].size );
+        } else if( ptrs[ops[i].id] ) {
+            kfree( ptrs[ops[i].id] );
+            ptrs[ops[i].id] = NULL;
+        }
+    }
+
+    return now() - start;
+}
+
+/*
+ * Bytes of memory from the start of the heap to the end of a block,
+ * leaving out the hole.
+ */
+static unsigned long span( void *p, unsigned int size ) {
+
+    unsigned long       end = (unsigned long)p + size;
+
+    if( end <= HOLESTART ) {
+        return end - KERNEL_END;
+    }
+
+    return ( HOLESTART - KERNEL_END ) + ( end - HOLEEND );
+}
+
+static double now( void ) {
+
+    struct timespec     ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * An allocator that corrupts its own lists usually ends up following a
+ * bad pointer. Say which operation it was on rather than just dying.
+ */
+static void crashed( int sig ) {
+
+    char                buf[160];
+    int                 n;
+
+    if( current < 0 ) {
+        signal( sig, SIG_DFL );
+        return;
+    }
+
+    n = snprintf( buf, sizeof( buf ), "%s: crashed at op %d, %s of id %d\n",
+                  name, current,
+                  ops[current].kind == OP_ALLOC ? "kmalloc" : "kfree",
+                  ops[current].id );
+    write( 2, buf, n );
+    _exit( 3 );
+}
@@ -0,0 +1,239 @@
+/*
+ * arena.c : per-process heap arenas
+ *
+ * Each process gets its own heap, made of chunks carved from the kernel
+ * allocator. Small requests are rounded up to one of ARENA_CLASSES power
+ * of two size classes and are bump allocated from the newest chunk, or
+ * reused from the free list for their class. Requests too big for the
+ * largest class get a chunk of their own.
+ *
+ * Nothing is returned to the kernel allocator until the process exits,
+ * when arena_release hands back every chunk at once. Chunks are charged
+ * to the process's memory group for as long as the arena holds them.
+ *
+ * - void *arena_alloc( pcb *proc, int size );
+ *     Allocate size bytes from proc's arena
+ *
+ * - int arena_free( pcb *proc, void *ptr );
+ *     Return an object to proc's arena
+ *
+ * - void arena_release( pcb *proc );
+ *     Free every chunk of proc's arena
+ */
+
+#include <xeroskernel.h>
+
+/* Size of the chunks small objects are bump allocated from */
+#define ARENA_CHUNK     (4096 * 4)
+/* Smallest size class, including the object header */
+#define ARENA_MIN       16
+/* Size class of objects that get a chunk of their own */
+#define ARENA_LARGE     ARENA_CLASSES
+/* Mixed with an object's address to mark it as allocated */
+#define ARENA_SANITY    0xA7E9A000
+
+
+typedef struct struct_chunk chunk;
+struct struct_chunk {
+  chunk         *next;   /* Next chunk in the arena                  */
+  unsigned char *bump;   /* First unused byte of the chunk           */
+  unsigned char *end;    /* End of the chunk                         */
+  int            pad;    /* Keeps objects 16 byte aligned            */
+};
+
+typedef struct struct_obj obj;
+struct struct_obj {
+  obj           *next;   /* Next free object of this class, if free  */
+  unsigned long  sanity; /* Address ^ ARENA_SANITY while allocated   */
+  int            class;  /* Size class, or ARENA_LARGE               */
+  chunk         *chunk;  /* Chunk holding the object                 */
+};
+
+
+/* Internal Helpers */
+static chunk *new_chunk( pcb *proc, int size );
+static int    size_class( int need );
+
+
+/*
+ * Allocates memory from a process's arena.
+ *
+ * Arguments:
+ *   proc - the process to allocate for
+ *   size - number of bytes wanted
+ *
+ * Returns:
+ *   pointer to 16 byte aligned memory of at least size bytes
+ *   NULL if size is invalid or there is no memory left
+ */
+void *arena_alloc( pcb *proc, int size ) {
+
+  chunk  *c;
+  obj    *o;
+  int     class, need;
+
+  if ( size <= 0 ) return NULL;
+
+  need = ( size + sizeof( obj ) + 0xf ) & ~0xf;
+  class = size_class( need );
+
+  if ( class == ARENA_LARGE ) {
+    // Big objects get a chunk of their own, kept behind the chunk
+    // small objects are being bump allocated from
+    c = new_chunk( proc, need );
+    if ( !c ) return NULL;
+    if ( proc->arena ) {
+      c->next = ((chunk *) proc->arena)->next;
+      ((chunk *) proc->arena)->next = c;
+    } else {
+      proc->arena = c;
+    }
+    o = (obj *) c->bump;
+    c->bump = c->end;
+
+  } else if ( proc->arena_free[class] ) {
+    // Reuse a freed object of the same class
+    o = proc->arena_free[class];
+    proc->arena_free[class] = o->next;
+    c = o->chunk;
+
+  } else {
+    // Bump allocate from the newest chunk, starting a new one if full
+    need = ARENA_MIN << class;
+    c = proc->arena;
+    if ( !c || c->end - c->bump < need ) {
+      c = new_chunk( proc, ARENA_CHUNK - sizeof( chunk ) );
+      if ( !c ) return NULL;
+      c->next = proc->arena;
+      proc->arena = c;
+    }
+    o = (obj *) c->bump;
+    c->bump += need;
+  }
+
+  o->next = NULL;
+  o->sanity = (unsigned long) o ^ ARENA_SANITY;
+  o->class = class;
+  o->chunk = c;
+
+  return o + 1;
+}
+
+/*
+ * Returns an object to a process's arena. Objects from a size class
+ * go on that class's free list; large objects give their chunk back
+ * to the kernel.
+ *
+ * Arguments:
+ *   proc - the process freeing the object
+ *   ptr  - pointer returned by arena_alloc for proc
+ *
+ * Returns:
+ *    0 on success
+ *   -1 if ptr was not allocated from proc's arena
+ */
+int arena_free( pcb *proc, void *ptr ) {
+
+  obj    *o = (obj *) ptr - 1;
+  chunk  *c, *prev = NULL;
+
+  // check ptr is inside one of the process's chunks
+  for ( c = proc->arena; c; prev = c, c = c->next ) {
+    if ( (unsigned char *) ptr > (unsigned char *) c
+         && (unsigned char *) ptr < c->bump ) break;
+  }
+
+  if ( !c || o->sanity != ((unsigned long) o ^ ARENA_SANITY) ) {
+    return -1;
+  }
+
+  o->sanity = 0;
+
+  if ( o->class == ARENA_LARGE ) {
+    if ( prev ) {
+      prev->next = c->next;
+    } else {
+      proc->arena = c->next;
+    }
+    kmemuncharge( proc, c->end - (unsigned char *) c );
+    kfree( c );
+  } else {
+    o->next = proc->arena_free[o->class];
+    proc->arena_free[o->class] = o;
+  }
+
+  return 0;
+}
+
+/*
+ * Frees every chunk in a process's arena.
+ *
+ * Arguments:
+ *   proc - the exiting process
+ */
+void arena_release( pcb *proc ) {
+
+  chunk  *c, *next;
+  int     i;
+
+  for ( c = proc->arena; c; c = next ) {
+    next = c->next;
+    kmemuncharge( proc, c->end - (unsigned char *) c );
+    kfree( c );
+  }
+
+  proc->arena = NULL;
+  for ( i = 0; i < ARENA_CLASSES; i++ ) {
+    proc->arena_free[i] = NULL;
+  }
+}
+
+/*
+ * Carves a new chunk out of the kernel allocator. The caller links it
+ * into the arena.
+ *
+ * Arguments:
+ *   proc - the process the chunk belongs to
+ *   size - usable bytes wanted in the chunk
+ *
+ * Returns:
+ *   the new chunk, NULL if the kernel is out of memory or the chunk
+ *   would take proc's group over its memory limit
+ */
+static chunk *new_chunk( pcb *proc, int size ) {
+
+  chunk  *c;
+
+  if ( kmemcharge( proc, sizeof( chunk ) + size, FALSE ) < 0 ) return NULL;
+
+  c = kmalloc( sizeof( chunk ) + size );
+  if ( !c ) {
+    kmemuncharge( proc, sizeof( chunk ) + size );
+    return NULL;
+  }
+
+  kmemowner( c, proc->pid );
+
+  c->bump = (unsigned char *) ( c + 1 );
+  c->end = c->bump + size;
+  c->next = NULL;
+
+  return c;
+}
+
+/*
+ * Finds the smallest size class that holds need bytes.
+ *
+ * Returns:
+ *   the size class, or ARENA_LARGE if need is bigger than all of them
+ */
+static int size_class( int need ) {
+
+  int class;
+
+  for ( class = 0; class < ARENA_CLASSES; class++ ) {
+    if ( need <= ARENA_MIN << class ) return class;
+  }
+
+  return ARENA_LARGE;
+}
@@ -3,6 +3,7 @@
 
 #include <xeroskernel.h>
 #include <xeroslib.h>
+#include <i386.h>
 
 pcb     proctab[MAX_PROC];
 
@@ -15,6 +16,23 @@ pcb     proctab[MAX_PROC];
 static int      nextpid = 0;
 
 
+// Stack high-water marks measured when processes exit, keyed by the
+// function the process was started in. When STACK_RIGHTSIZE is on,
+// create() uses these to honour stack requests below PROC_STACK.
+
+#define MAX_STACK_PROFILES 32
+
+typedef struct struct_stackprof stackprof;
+struct struct_stackprof {
+    funcptr     entry;   /* Function processes of this kind start in */
+    size_t      hwm;     /* Deepest stack use seen on exit           */
+};
+
+static stackprof stack_profile[MAX_STACK_PROFILES];
+
+static stackprof *find_profile( funcptr fp );
+static size_t     stack_size( funcptr fp, size_t stackSize );
+
 
 int create( funcptr fp, size_t stackSize ) {
 /***********************************************/
@@ -38,10 +56,9 @@ int create( funcptr fp, size_t stackSize ) {
     if (nextpid < 0)
       return CREATE_FAILURE;
 
-    // If the stack is too small make it larger
-    if( stackSize < PROC_STACK ) {
-        stackSize = PROC_STACK;
-    }
+    // If the stack is too small make it larger, unless it has been
+    // shown to be big enough
+    stackSize = stack_size( fp, stackSize );
 
     for( i = 0; i < MAX_PROC; i++ ) {
         if( proctab[i].state == STATE_STOPPED ) {
@@ -61,17 +78,28 @@ int create( funcptr fp, size_t stackSize ) {
     }
 
 
-    cf = kmalloc( stackSize );
+    // Only the address space is reserved here. Pages are added, filled
+    // with STACK_FILL, as the process touches them and the unmapped page
+    // below the stack catches overflows.
+    cf = stack_reserve( p, stackSize );
     if( !cf ) {
         return CREATE_FAILURE;
     }
 
+    p->stack = cf;
+    p->stackSize = stackSize;
+    p->timerSlack = TIMER_SLACK;
+
+    // Charges start in a group of the process's own; syscreate moves
+    // the process into its creator's group
+    kmemgroup( p );
+    p->stackHWM = 0;
+    p->entry = fp;
+
     // The -4 gets us one extra stack spot for the return address
     cf = (context_frame *)((unsigned char *)cf + stackSize - 4);
     cf--;
 
-    memset(cf, 0xA5, sizeof( context_frame ));
-
     cf->iret_cs = getCS();
     cf->iret_eip = (unsigned int)fp;
     cf->eflags = STARTING_EFLAGS | ARM_INTERRUPTS;
@@ -82,13 +110,32 @@ int create( funcptr fp, size_t stackSize ) {
     p->esp = (unsigned long*)cf;
     p->state = STATE_READY;
     p->pid = nextpid++;
-    p->cpuTime = 0;
+    p->userTime = 0;
+    p->sysTime = 0;
+    p->userNs = 0;
+    p->sysNs = 0;
     p->wait_head = NULL;
     p->wait_tail = NULL;
     p->waiting_proc = NULL;
     p->processing = 0;
+    p->arena = NULL;
+    for ( i = 0; i < ARENA_CLASSES; i++ ) {
+      p->arena_free[i] = NULL;
+    }
 
     p->signals = 0;
+    p->sigMask = 0;
+    p->timeout = 0;
+    p->paused = 0;
+    p->sigStack = NULL;
+    p->sigStackSize = 0;
+    p->sigCount = 0;
+    p->sigWaitMask = 0;
+    p->ppid = 0;
+    p->exitStatus = 0;
+    p->childSig = SIGCHLD;
+    p->exitedCount = 0;
+    p->exitedLost = 0;
     for ( i = 0; i < MAX_SIGNALS; i++ ) {
       p->sig_handlers[i] = (void *) NULL;
     }
@@ -100,3 +147,120 @@ int create( funcptr fp, size_t stackSize ) {
     ready( p );
     return p->pid;
 }
+
+
+/*
+ * Works out how big a stack to give a new process. Requests below
+ * PROC_STACK are bumped up to PROC_STACK unless right-sizing is on and
+ * earlier processes started in fp have never come within STACK_SLACK
+ * bytes of the requested size.
+ *
+ * Arguments:
+ *   fp - the function the process will start in
+ *   stackSize - the requested stack size
+ *
+ * Returns:
+ *   the stack size to reserve, a multiple of NBPG
+ */
+static size_t stack_size( funcptr fp, size_t stackSize ) {
+    stackprof   *prof;
+
+    if( stackSize < PROC_STACK ) {
+        prof = find_profile( fp );
+
+        if( !STACK_RIGHTSIZE || !prof || prof->entry != fp
+            || prof->hwm + STACK_SLACK > stackSize ) {
+            stackSize = PROC_STACK;
+        } else if( stackSize < STACK_MIN ) {
+            stackSize = STACK_MIN;
+        }
+    }
+
+    return ( stackSize + NBPG - 1 ) & ~( NBPG - 1 );
+}
+
+/*
+ * Finds the stack profile for processes started in fp.
+ *
+ * Returns:
+ *   the profile for fp if there is one
+ *   otherwise a free profile, or NULL if the table is full
+ */
+static stackprof *find_profile( funcptr fp ) {
+    stackprof   *free = NULL;
+    int         i;
+
+    for( i = 0; i < MAX_STACK_PROFILES; i++ ) {
+        if( stack_profile[i].entry == fp ) {
+            return &stack_profile[i];
+        }
+        if( !free && !stack_profile[i].entry ) {
+            free = &stack_profile[i];
+        }
+    }
+
+    return free;
+}
+
+/*
+ * Measures how much of a process's stack has been touched by looking
+ * for the deepest word that no longer holds the fill pattern. Pages
+ * that were never touched are not mapped and are skipped.
+ *
+ * Arguments:
+ *   p - the process whose stack to measure
+ *
+ * Returns:
+ *   number of bytes of stack used
+ */
+size_t stack_used( pcb *p ) {
+    unsigned long   fill;
+    unsigned long   *sp;
+    unsigned long   *top;
+
+    memset(&fill, STACK_FILL, sizeof( fill ));
+
+    sp = (unsigned long *)p->stack;
+    top = (unsigned long *)((unsigned char *)p->stack + p->stackSize);
+
+    for( ; sp < top; sp++ ) {
+        if( !((unsigned long)sp & (NBPG - 1)) && !page_mapped( sp ) ) {
+            sp += NBPG / sizeof( *sp ) - 1;
+        } else if( *sp != fill ) {
+            break;
+        }
+    }
+
+    return (unsigned char *)top - (unsigned char *)sp;
+}
+
+/*
+ * Records the high-water mark of an exiting process so later processes
+ * started in the same function can be given a right-sized stack.
+ *
+ * Arguments:
+ *   p - the process that is exiting
+ */
+void stack_exit( pcb *p ) {
+    stackprof   *prof;
+    size_t      used = stack_used( p );
+
+    // The page fault handler has already set it if the stack overflowed
+    if( used > p->stackHWM ) {
+        p->stackHWM = used;
+    }
+
+    prof = find_profile( p->entry );
+    if( !prof ) {
+        return;
+    }
+
+    if( prof->entry != p->entry ) {
+        prof->entry = p->entry;
+        prof->hwm = 0;
+    }
+
+    if( p->stackHWM > prof->hwm ) {
+        prof->hwm = p->stackHWM;
+    }
+}
@@ -117,6 +117,6 @@ void contextinit( void ) {
   set_evec( KERNEL_INT, (int) _KernelEntryPoint );
   set_evec( TIMER_INT,  (int) _TimerEntryPoint );
   set_evec( KEYBOARD_INT, (int) _KeyboardEntryPoint);
-  initPIT( 100 );
+  hrtimer_init();
 
 }
@@ -22,7 +22,10 @@
  * Bool di_ioctl(pcb *proc, int fd, unsigned long command, va_list varargs) {
  *   Handles device specific commands and sets the pcb return code
  *
- * Bool verify_buffer(void *buffer, int buflen)
+ * void dev_notify(devsw *dev);
+ *   Signals the process waiting to hear that a device has data
+ *
+ * Bool verify_buffer(pcb *proc, void *buffer, int buflen)
  *   Verifies buffer is in valid location and buflen is valid
 */
 
@@ -30,16 +33,20 @@
 #include <i386.h>
 
 
-extern char *maxaddr;
 
 /* Internal Helpers   */
-static Bool verify_buffer(void *buf, int buflen);
+static Bool verify_buffer(pcb *proc, void *buf, int buflen);
 
 
 /*
  * Initialize devices
  */
 void devices_init() {
+  int i;
+
+  for ( i = 0; i < MAX_KERN_DEVICES; i++ ) {
+    dev_tab[i].notify_pid = 0;
+  }
   keyboards_init();
 }
 
@@ -121,6 +128,7 @@ Bool di_close(pcb *proc, int fd) {
 
   // reset file descriptor
   proc->fd_tab[fd] = (devsw *) NULL_DEVICE;
+  if ( dev->notify_pid == proc->pid ) dev->notify_pid = 0;
 
   proc->ret = 0;
   return FALSE;
@@ -155,7 +163,7 @@ Bool di_read(pcb *proc, int fd, void *buf, int buflen) {
   }
 
   // check if buffer and buflen is valid
-  if ( !verify_buffer(buf, buflen) ) {
+  if ( !verify_buffer(proc, buf, buflen) ) {
     return FALSE;
   }
 
@@ -198,7 +206,7 @@ Bool di_write(pcb *proc, int fd, void *buf, int buflen) {
   }
 
   // check if buffer and buflen is valid
-  if ( !verify_buffer(buf, buflen) ) {
+  if ( !verify_buffer(proc, buf, buflen) ) {
     return FALSE;
   }
 
@@ -213,7 +221,10 @@ Bool di_write(pcb *proc, int fd, void *buf, int buflen) {
 }
 
 /*
- * Handles device specific commands and sets the pcb return code
+ * Handles device specific commands and sets the pcb return code.
+ * DEV_NOTIFY, with a signal number, is handled here for every device:
+ * the process is sent that signal each time the device's driver has
+ * data for it to read, until it passes -1 or closes the device.
  *
  * Arguments:
  *   pcb using device
@@ -239,6 +250,23 @@ Bool di_ioctl(pcb *proc, int fd, unsigned long command, va_list varargs) {
   }
 
   devsw *dev = proc->fd_tab[fd];
+
+  if ( command == DEV_NOTIFY ) {
+    int sig_no = va_arg( varargs, int );
+
+    if ( sig_no == -1 ) {
+      if ( dev->notify_pid == proc->pid ) dev->notify_pid = 0;
+    } else if ( sig_no >= 0 && sig_no < MAX_SIGNALS ) {
+      dev->notify_pid = proc->pid;
+      dev->notify_sig = sig_no;
+    } else {
+      return FALSE;
+    }
+
+    proc->ret = 0;
+    return FALSE;
+  }
+
   int result = (dev->dev_ioctl)(proc, dev, command, varargs);
 
   // If BLOCK status is returned, block the process
@@ -248,10 +276,29 @@ Bool di_ioctl(pcb *proc, int fd, unsigned long command, va_list varargs) {
   return FALSE;
 }
 
+/*
+ * Signals the process that armed DEV_NOTIFY on a device. Drivers call
+ * this from their lower half when data comes in that a read would
+ * take, so the process does not have to sit blocked in a read.
+ *
+ * Arguments:
+ *   device that has data
+ */
+void dev_notify(devsw *dev) {
+
+  if ( !dev->notify_pid ) return;
+
+  // The process has gone without closing the device
+  if ( signal(dev->notify_pid, dev->notify_sig) == -1 ) {
+    dev->notify_pid = 0;
+  }
+}
+
 /*
  * Verifies buffer is in valid location and buflen is valid
  *
  * Arguments:
+ *   process passing the buffer
  *   pointer to the buffer
  *   length of buffer
  *
@@ -259,20 +306,16 @@ Bool di_ioctl(pcb *proc, int fd, unsigned long command, va_list varargs) {
  *   TRUE if both valid
  *   FALSE if not.
  */
-Bool verify_buffer(void *buffer, int buflen) {
+Bool verify_buffer(pcb *proc, void *buffer, int buflen) {
 
-  // check if buffer is valid
-  if ( buffer < 0 || ((char *) buffer) > maxaddr ) {
-    return FALSE;
-  }
-
-  // check if buffer is in hole
-  if ( ((unsigned long) buffer > HOLESTART) && ((unsigned long) buffer < HOLEEND) ) {
+  // check if buflen is valid
+  if ( buflen <= 0 ) {
     return FALSE;
   }
 
-  // check if buflen is valid
-  if ( buflen <= 0 ) {
+  // check the whole buffer is in memory, not in the hole, and not in
+  // another process's stack
+  if ( !user_range_ok(proc, buffer, buflen) ) {
     return FALSE;
   }
 
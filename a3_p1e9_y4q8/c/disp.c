@@ -13,12 +13,17 @@ extern int      idle_pid;
 
 
 static int  kill(pcb *currP, int pid);
+static void charge(unsigned long *us, unsigned int *ns,
+                   unsigned long long from, unsigned long long to);
+static void timed_out(void *arg);
+static void child_exited(pcb *p);
+static int  waitany(pcb *p, int *pid, int *status);
 
 
 void     dispatch( void ) {
 /********************************/
 
-    pcb         *p;
+    pcb         *p, *child;
     int         r;
     funcptr     fp;
     int         stack;
@@ -33,16 +38,27 @@ void     dispatch( void ) {
     unsigned long command;
     int         device_no;
     Bool         block;
+    pcb         *trapped = NULL;
+    unsigned long long  in, out = gettime();
 
     for( p = next(); p; ) {
 
       // If the process has been signaled setup the stack to handle it
-      if ( !p->processing && p->signals > 0 ) {
-        setup_sigtramp( p );
-        p->processing = 1;
+      if ( !p->processing && (p->signals & ~p->sigMask) ) {
+        p->processing = setup_sigtramp( p ) > 0;
       }
 
+      // Time since the last process came in was spent serving it
+      in = gettime();
+      if ( trapped ) charge( &trapped->sysTime, &trapped->sysNs, out, in );
+
+      p->state = STATE_RUNNING;
       r = contextswitch( p );
+
+      out = gettime();
+      charge( &p->userTime, &p->userNs, in, out );
+      trapped = p;
+
       switch( r ) {
 
       case( SYS_CREATE ):
@@ -50,6 +66,22 @@ void     dispatch( void ) {
         fp = (funcptr)(va_arg( ap, int ) );
         stack = va_arg( ap, int );
 	      p->ret = create( fp, stack );
+
+        if ( p->ret != CREATE_FAILURE ) {
+          child = findPCB( p->ret );
+          child->timerSlack = p->timerSlack;
+          child->ppid = p->pid;
+
+          // Charge the new process to its creator's group, unless that
+          // cannot afford even the process's first stack page. create
+          // has already made it ready, so take it back off the queue.
+          if ( kmemjoin( child, p ) < 0 ) {
+            child->ppid = 0;
+            removeFromReady( child );
+            stop( child );
+            p->ret = CREATE_FAILURE;
+          }
+        }
         break;
 
       case( SYS_YIELD ):
@@ -58,6 +90,8 @@ void     dispatch( void ) {
         break;
 
       case( SYS_STOP ):
+        ap = (va_list)p->args;
+        p->exitStatus = va_arg( ap, int );
         stop(p);
         p = next();
         break;
@@ -74,6 +108,55 @@ void     dispatch( void ) {
         }
         break;
 
+      case ( SYS_SIGQUEUE ):
+        ap = (va_list)p->args;
+        pid = va_arg( ap, int );
+        signal_num = va_arg( ap, int );
+        p->ret = sigqueue( pid, signal_num, va_arg( ap, int ) );
+        if (p->ret == -1) {
+          p->ret = -712;
+        } else if (p->ret == -2) {
+          p->ret = -651;
+        }
+        break;
+
+      case ( SYS_SIGMASK ):
+        ap = (va_list)p->args;
+        signal_num = va_arg( ap, int );
+        command = va_arg( ap, unsigned int );
+        p->ret = sigprocmask( p, signal_num, command, va_arg( ap, unsigned int * ) );
+        break;
+
+      case ( SYS_SIGSTACK ):
+        ap = (va_list)p->args;
+        buf = va_arg( ap, void * );
+        p->ret = sigaltstack( p, buf, va_arg( ap, int ) );
+        break;
+
+      case ( SYS_SIGWAIT ):
+        ap = (va_list)p->args;
+        command = va_arg( ap, unsigned int );
+        buf = va_arg( ap, void * );
+        if ( sigwait( p, command, buf, va_arg( ap, int * ) ) ) p = next();
+        break;
+
+      case ( SYS_WAITANY ):
+        ap = (va_list)p->args;
+        buf = va_arg( ap, void * );
+        p->ret = waitany( p, buf, va_arg( ap, int * ) );
+        break;
+
+      case ( SYS_CHILDSIG ):
+        ap = (va_list)p->args;
+        signal_num = va_arg( ap, int );
+        if ( signal_num < -1 || signal_num >= MAX_SIGNALS ) {
+          p->ret = -651;
+        } else {
+          p->ret = p->childSig;
+          p->childSig = signal_num;
+        }
+        break;
+
       case ( SYS_KILL_PROC ):
         ap = (va_list)p->args;
         p->ret = kill(p, va_arg( ap, int ) );
@@ -102,11 +185,57 @@ void     dispatch( void ) {
       	p = next();
       	break;
 
+      case( SYS_TIMERSLACK ):
+        ap = (va_list)p->args;
+        p->ret = p->timerSlack;
+        p->timerSlack = va_arg( ap, unsigned int );
+        if ( !p->timerSlack ) p->timerSlack = TIMER_SLACK;
+        break;
+
+      case( SYS_SLEEPUNTIL ):
+        ap = (va_list)p->args;
+        p->ret = 0;
+        sleepuntil( p, va_arg( ap, unsigned long ) );
+        p = next();
+        break;
+
+      case( SYS_GETTICKS ):
+        p->ret = ticks;
+        break;
+
+      case( SYS_GETTIME ):
+        ap = (va_list)p->args;
+        buf = va_arg( ap, void * );
+        if ( ((unsigned long) buf >= HOLESTART) && ((unsigned long) buf <= HOLEEND) ) {
+          p->ret = -1;
+        } else if ( !user_range_ok( p, buf, sizeof( unsigned long long ) ) ) {
+          p->ret = -1;
+        } else {
+          *(unsigned long long *) buf = gettime();
+          p->ret = 0;
+        }
+        break;
+
+      case( SYS_SETITIMER ):
+        ap = (va_list)p->args;
+        signal_num = va_arg( ap, int );
+        len = va_arg( ap, unsigned int );
+        p->ret = setitimer( p, signal_num, len, va_arg( ap, unsigned int ) );
+        break;
+
+      case( SYS_NANOSLEEP ):
+      	ap = (va_list)p->args;
+      	nanosleep( p, va_arg( ap, unsigned int ) );
+      	p = next();
+      	break;
+
       case( SYS_TIMER ):
-      	tick();
+      	// Runs tick() for each tick that passed; the interrupt may also
+      	// be for a high resolution timer, which could have woken someone
+      	hrtimer_interrupt();
       	//kprintf("T");
-      	p->cpuTime++;
-      	ready( p );
+      	// A timer's signal may have killed the process
+      	if ( p->state == STATE_RUNNING ) ready( p );
       	p = next();
       	end_of_intr();
       	break;
@@ -122,8 +251,8 @@ void     dispatch( void ) {
       case( SYS_SIGRETURN ):
         ap = (va_list)p->args;
         int *old_sp = va_arg( ap, int * );
-        // Get the return value we pushed onto the stack
-        p->ret = *(old_sp - 1);
+        // Get back the return value of the call the handlers cut off
+        p->ret = p->sigRet;
         p->esp = old_sp;
         context_frame *cf = (context_frame *) p->esp;
         cf->esp = (int)old_sp;
@@ -187,14 +316,76 @@ void     dispatch( void ) {
         if (block) p = next();
         break;
 
+      case( SYS_MALLOC ):
+        ap = (va_list)p->args;
+        p->ret = (int) arena_alloc( p, va_arg( ap, int ) );
+        break;
+
+      case( SYS_FREE ):
+        ap = (va_list)p->args;
+        p->ret = arena_free( p, va_arg( ap, void * ) );
+        break;
+
+      case( SYS_MEMINFO ):
+        ap = (va_list)p->args;
+        p->ret = getmeminfo( p, va_arg( ap, meminfo * ) );
+        break;
+
+      case( SYS_MEMLIMIT ):
+        ap = (va_list)p->args;
+        pid = va_arg( ap, int );
+        p->ret = setmemlimit( p, pid, va_arg( ap, unsigned long ) );
+        break;
+
+      case( SYS_MEMTRACE ):
+        ap = (va_list)p->args;
+        buf = va_arg( ap, void * );
+        buflen = va_arg( ap, int );
+        p->ret = getmemtrace( p, buf, buflen );
+        break;
+
       case( SYS_KEYBD ):
         keyboard_int_handler();
         end_of_intr();
         break;
 
+      case( SYS_TIMEOUT ):
+        ap = (va_list)p->args;
+        len = va_arg( ap, unsigned int );
+        p->timeout = ( len + MILLISECONDS_TICK - 1 ) / MILLISECONDS_TICK;
+        p->ret = 0;
+        break;
+
       default:
         kprintf( "Bad Sys request %d, pid = %d\n", r, p->pid );
       }
+
+      // The call touched a bad address in the stack region, that its
+      // checks let through; the kernel was lent a page to finish with
+      if ( stack_strayed() ) {
+        kprintf( "Process %d passed a bad address, stopping it\n", trapped->pid );
+        terminate( trapped, SIGKILL );
+      }
+
+      // A timeout set with syssettimeout is for the next call the
+      // process makes. If that call blocked, start the timer.
+      if ( trapped->timeout && r != SYS_TIMEOUT && r != SYS_TIMER && r != SYS_KEYBD ) {
+        if ( trapped->state == STATE_WAIT || trapped->state == STATE_READ ||
+             trapped->state == STATE_SIGWAIT ) {
+          timer_add( &trapped->blockTimer, trapped->timeout,
+                     trapped->timerSlack / ( MILLISECONDS_TICK * 1000000 ),
+                     timed_out, trapped );
+        }
+        trapped->timeout = 0;
+      }
+
+      // The call may have killed or stopped the process that made it
+      if ( p->state == STATE_STOPPED ) {
+        p = next();
+      } else if ( p->state == STATE_RUNNING && p->paused ) {
+        ready( p );
+        p = next();
+      }
     }
 
     kprintf( "Out of processes: dying\n" );
@@ -213,6 +404,15 @@ extern void dispatchinit( void ) {
 
 extern void     ready( pcb *p ) {
 /*******************************/
+    // However it woke, a blocking call's timeout is no longer needed
+    if ( p->blockTimer.list ) timer_cancel( &p->blockTimer );
+
+    // A stopped process is parked until SIGCONT instead
+    if ( p->paused ) {
+      p->state = STATE_PAUSED;
+      return;
+    }
+
     enqueue(&ready_head, &ready_tail, p);
     p->state = STATE_READY;
 }
@@ -351,10 +551,7 @@ pcb *findPCB( int pid ) {
 
 // This function takes a pointer to the pcbtab entry of the currently active process.
 // The functions purpose is to remove the process being pointed to from the ready Q
-// A similar function exists for the management of the sleep Q. Things should be re-factored to
-// eliminate the duplication of code if possible. There are some challenges to that because
-// the sleepQ is a delta list and something more than just removing an element in a list
-// is being preformed.
+// Sleeping processes are taken off their timer with removeFromSleep instead.
 
 void removeFromReady(pcb * p) {
 
@@ -371,12 +568,33 @@ void removeFromReady(pcb * p) {
 }
 
 /*
- * Stop process and notify waiting processes.
+ * Stop process, release everything it holds and notify waiting
+ * processes.
  *
  * Arguments:
  *  p - pointer to the pcb
  */
 void stop(pcb *p) {
+  int i;
+
+  // Close any open devices.
+  for( i = 0; i < MAX_PROC_DEVICES; i ++ ) {
+    devsw *dev = p->fd_tab[i];
+    if ( (int) dev != NULL_DEVICE) {
+      (dev->dev_close)(p, dev);
+      if ( dev->notify_pid == p->pid ) dev->notify_pid = 0;
+    }
+  }
+
+  // Hand the whole heap arena and the stack back in one go
+  arena_release(p);
+  stack_exit(p);
+  stack_release(p);
+  p->stack = NULL;
+  kmemcheck(p->pid);
+  kmemleave(p);
+  timer_cancel(&p->itimer);
+  timer_cancel(&p->blockTimer);
 
   p->state = STATE_STOPPED;
 
@@ -385,6 +603,71 @@ void stop(pcb *p) {
     wake->ret = 0;
     ready(wake);
   }
+
+  child_exited(p);
+}
+
+
+/*
+ * Takes a process off whatever queue it is on and stops it. This is
+ * SIGKILL, and what SIGTERM does with no handler.
+ *
+ * Arguments:
+ *  p - pointer to the pcb
+ *  sig_no - the signal that ended it, kept as its exit status
+ */
+void terminate(pcb *p, int sig_no) {
+
+  p->exitStatus = -sig_no;
+
+  switch( p->state ) {
+  case( STATE_READY ):
+    removeFromReady(p);
+    break;
+
+  case( STATE_SLEEP ):
+    removeFromSleep(p);
+    break;
+
+  case( STATE_WAIT ):
+    remove(&p->waiting_proc->wait_head, &p->waiting_proc->wait_tail, p);
+    break;
+
+  case( STATE_READ ):
+    // A reader paused by SIGSTOP is parked by ready(), not queued
+    unblock_proc();
+    if ( p->state == STATE_READY ) removeFromReady(p);
+    break;
+  }
+
+  // A running process is taken off the CPU by the dispatcher, and a
+  // paused one is on no queue
+  stop(p);
+}
+
+/*
+ * Stops a process from running until resume, for SIGSTOP. A blocked
+ * process finishes its call first, and is parked when it would have
+ * been made ready.
+ */
+void suspend(pcb *p) {
+
+  p->paused = 1;
+
+  if ( p->state == STATE_READY ) {
+    removeFromReady(p);
+    p->state = STATE_PAUSED;
+  }
+}
+
+/*
+ * Lets a process suspended by SIGSTOP run again, for SIGCONT.
+ */
+void resume(pcb *p) {
+
+  p->paused = 0;
+
+  if ( p->state == STATE_PAUSED ) ready(p);
 }
 
 
@@ -396,7 +679,6 @@ void stop(pcb *p) {
 //        filled with information about all the processes currently in the system
 //
 
-extern char * maxaddr;
 
 int getCPUtimes(pcb *p, processStatuses *ps) {
 
@@ -407,8 +689,8 @@ int getCPUtimes(pcb *p, processStatuses *ps) {
   if (((unsigned long) ps) >= HOLESTART && ((unsigned long) ps <= HOLEEND))
     return -1;
 
-  //Check if address of the data structure is beyone the end of main memory
-  if ((((char * ) ps) + sizeof(processStatuses)) > maxaddr)
+  //Check the data structure is in main memory, or this process's stack
+  if (!user_range_ok(p, ps, sizeof(processStatuses)))
     return -2;
 
   // There are probably other address checks that can be done, but this is OK for now
@@ -420,13 +702,56 @@ int getCPUtimes(pcb *p, processStatuses *ps) {
       currentSlot++;
       ps->pid[currentSlot] = proctab[i].pid;
       ps->status[currentSlot] = p->pid == proctab[i].pid ? STATE_RUNNING: proctab[i].state;
-      ps->cpuTime[currentSlot] = proctab[i].cpuTime * MILLISECONDS_TICK;
+      ps->userTime[currentSlot] = proctab[i].userTime;
+      ps->sysTime[currentSlot] = proctab[i].sysTime;
+      ps->cpuTime[currentSlot] = proctab[i].userTime + proctab[i].sysTime;
+      ps->stackSize[currentSlot] = proctab[i].stackSize;
+      ps->stackUsed[currentSlot] = stack_used(&proctab[i]);
+      ps->memUsed[currentSlot] = proctab[i].memUsed;
+      kmemusage(&proctab[i], &ps->groupUsed[currentSlot], &ps->memLimit[currentSlot]);
     }
   }
 
   return currentSlot;
 }
 
+// Adds the time from from to to, in ns, to a CPU time kept in us with
+// the ns left over. It is kept this way so there is no 64 bit divide.
+// A process only runs until the next tick, so the time fits 32 bits.
+//
+static void charge(unsigned long *us, unsigned int *ns,
+                   unsigned long long from, unsigned long long to) {
+  unsigned long long d = to - from;
+
+  if ( to < from ) return;
+  if ( d >> 32 ) d = 0xffffffffUL;
+
+  *ns += (unsigned long) d % 1000;
+  *us += (unsigned long) d / 1000 + *ns / 1000;
+  *ns %= 1000;
+}
+
+// Called when a blocking call's timeout runs out. Takes the process off
+// what it is blocked on, and returns TIMEOUT, or for a read the bytes
+// read so far if there are any.
+//
+static void timed_out(void *arg) {
+  pcb *p = arg;
+
+  if ( p->state == STATE_WAIT ) {
+    remove(&p->waiting_proc->wait_head, &p->waiting_proc->wait_tail, p);
+    p->ret = TIMEOUT;
+    ready(p);
+  } else if ( p->state == STATE_READ ) {
+    unblock_proc();
+    if ( p->ret <= 0 ) p->ret = TIMEOUT;
+  } else if ( p->state == STATE_SIGWAIT ) {
+    p->sigWaitMask = 0;
+    p->ret = TIMEOUT;
+    ready(p);
+  }
+}
+
 // This function takes 2 paramenters and kills the process with pid:
 //  currP  - a pointer into the pcbtab that identifies the currently running process
 //  pid    - the proces ID of the process to be killed.
@@ -446,39 +771,71 @@ static int  kill(pcb *currP, int pid) {
   }
 
   
-  // PCB has been found,  and the proces is either sleepign or running.
-  // based on that information remove the process from 
-  // the appropriate queue/list.
+  terminate(targetPCB, SIGKILL);
+  return 0;
+}
 
-  if (targetPCB->state == STATE_SLEEP) {
-    // kprintf("Target pid %d sleeping\n", targetPCB->pid);
-    removeFromSleep(targetPCB);
-  }
+// Called when a process stops. Records its pid and exit status with
+// the process that created it, for syswaitany, and sends that process
+// its child signal. A creator that already has EXITED_MAX children
+// waiting to be reaped still gets the signal, and the child is counted
+// so syswaitany can say it exited, but its pid and status are lost.
+//
+static void child_exited(pcb *p) {
+  pcb *parent = findPCB( p->ppid );
 
-  if (targetPCB->state == STATE_READY) {
-    // remove from ready queue
-    // kprintf("Target pid %d is ready\n", targetPCB->pid);
-    removeFromReady(targetPCB);
-  }
+  if ( !parent ) return;
 
-  if (targetPCB->state == STATE_WAIT) {
-    remove(&targetPCB->waiting_proc->wait_head,
-           &targetPCB->waiting_proc->wait_tail, targetPCB);
+  if ( parent->exitedCount < EXITED_MAX ) {
+    parent->exitedPids[parent->exitedCount] = p->pid;
+    parent->exitedStatus[parent->exitedCount] = p->exitStatus;
+    parent->exitedCount++;
+  } else {
+    parent->exitedLost++;
   }
 
-  // Close any open processes.
+  if ( parent->childSig >= 0 ) signal( parent->pid, parent->childSig );
+}
+
+// This function is the system side of syswaitany. It takes the oldest
+// child of p that has exited without blocking.
+//  p      - the process reaping its children
+//  pid    - where to put the child's pid, or NULL
+//  status - where to put its exit status, or NULL
+//
+// Returns 0 if a child was reaped, 1 if one was reaped whose record
+// did not fit, -1 if none have exited, and -2 if pid or status is at
+// an invalid address. The records are taken first.
+//
+static int  waitany(pcb *p, int *pid, int *status) {
+  int *out[2];
   int i;
-  for( i = 0; i < MAX_PROC_DEVICES; i ++ ) {
-    devsw *dev = targetPCB->fd_tab[i];
-    if ( (int) dev != NULL_DEVICE) (dev->dev_close)(targetPCB, dev);
+
+  out[0] = pid;
+  out[1] = status;
+  for ( i = 0; i < 2; i++ ) {
+    if ( !out[i] ) continue;
+    if ( ((unsigned long) out[i] >= HOLESTART) && ((unsigned long) out[i] <= HOLEEND) ) {
+      return -2;
+    }
+    if ( !user_range_ok( p, out[i], sizeof( int ) ) ) {
+      return -2;
+    }
+  }
+
+  if ( !p->exitedCount ) {
+    if ( !p->exitedLost ) return -1;
+
+    p->exitedLost--;
+    return 1;
   }
 
-  // Check other states and do state specific cleanup before stopping
-  // the process 
-  // In the new version the process will not be marked as stopped but be 
-  // put onto the readyq and a signal marked for delivery. 
+  if ( pid ) *pid = p->exitedPids[0];
+  if ( status ) *status = p->exitedStatus[0];
 
-  targetPCB->state = STATE_STOPPED;
+  p->exitedCount--;
+  blkcopy( &p->exitedPids[0], &p->exitedPids[1], p->exitedCount * sizeof( int ) );
+  blkcopy( &p->exitedStatus[0], &p->exitedStatus[1], p->exitedCount * sizeof( int ) );
   return 0;
 }
 
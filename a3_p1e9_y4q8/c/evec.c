@@ -48,6 +48,26 @@ void set_evec(unsigned int xnum, unsigned long handler)
 	pidt->igd_hoffset = handler >> 16;
 }
 
+
+/*------------------------------------------------------------------------
+ * set_taskgate - set exception vector to switch to the task whose TSS
+ *                descriptor is selector in the GDT
+ *------------------------------------------------------------------------
+ */
+void set_taskgate(unsigned int xnum, unsigned int selector)
+{
+	struct	idt	*pidt;
+
+	pidt = &idt[xnum];
+	pidt->igd_loffset = 0;
+	pidt->igd_segsel = selector;
+	pidt->igd_mbz = 0;
+	pidt->igd_type = IGDT_TASK;
+	pidt->igd_dpl = 0;
+	pidt->igd_present = 1;
+	pidt->igd_hoffset = 0;
+}
+
 char *inames[17] = {
 	"divided by zero",
 	"debug exception",
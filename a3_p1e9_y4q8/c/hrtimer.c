@@ -0,0 +1,328 @@
+/* hrtimer.c : high resolution timers
+ *
+ * The PIT runs in one-shot mode rather than interrupting every tick. It
+ * is set to go off at the next tick or the earliest high resolution
+ * deadline, whichever comes first, so timers are not rounded to ticks.
+ * Each interrupt works out how long it has been since the PIT was set,
+ * from the count it was set to and how far the counter has run past
+ * zero, and adds that to a nanosecond clock. Ticks fall out of the
+ * clock every TICK_NS.
+ *
+ * gettime reads the time from the TSC when the CPU has one, which is
+ * cheaper than reading the PIT back and finer than a PIT clock. How many
+ * nanoseconds a TSC cycle is gets measured against the PIT before the
+ * PIT is started. Without a TSC it reads the PIT, like hrclock.
+ *
+ * High resolution timers are kept on a list sorted by deadline. There
+ * are few of them, they are for processes that need better than a tick,
+ * so the list is short. A timer may go off up to its slack after its
+ * deadline: the PIT is set for the earliest deadline plus slack, and
+ * then every timer whose deadline has passed goes off with it, as do
+ * any whose deadline has passed by a tick. Timer functions are called
+ * from the dispatcher with interrupts off.
+ *
+ * - void hrtimer_init( void );
+ *     Start the PIT
+ *
+ * - unsigned long long hrclock( void );
+ *     Nanoseconds since the PIT was started
+ *
+ * - unsigned long long gettime( void );
+ *     The same clock, read from the TSC if there is one
+ *
+ * - void hrtimer_add( hrtimer *t, unsigned long long deadline,
+ *                     unsigned long slack, timerfn fn, void *arg );
+ *     Call fn(arg) when hrclock reaches deadline, or up to slack ns later
+ *
+ * - int hrtimer_cancel( hrtimer *t );
+ *     Stop a timer before it goes off
+ *
+ * - int hrtimer_interrupt( void );
+ *     Handle a PIT interrupt, returns the ticks that have passed
+ */
+
+#include <xeroskernel.h>
+#include <xeroslib.h>
+#include <i386.h>
+
+#define TICK_NS         ( MILLISECONDS_TICK * 1000000UL )
+
+/* A PIT clock is 838.1 ns; these keep the conversions in 32 bits. */
+/* NS_PIT rounds up so the PIT never goes off just short of a time.  */
+#define PIT_NS(c)       ( (c) * 8381UL / 10 )
+#define NS_PIT(ns)      ( ( (ns) * 10UL + 8380 ) / 8381 )
+
+/* PIT clocks to time the TSC over, about 50ms */
+#define CALIBRATE_PIT   60000
+
+
+static hrtimer            *hr_head;
+static unsigned long long hr_now;       /* Clock when the PIT was last set */
+static unsigned long long next_tick;    /* Clock of the next tick          */
+static unsigned int       programmed;   /* Count the PIT was last set to   */
+static unsigned long long event;        /* Clock the PIT will go off at    */
+static unsigned long long tsc_start;    /* TSC when the PIT was started    */
+static unsigned long long tsc_mult;     /* ns per TSC cycle, 32.32 fixed   */
+                                        /* point, 0 if there is no TSC     */
+
+
+/* Internal Helpers */
+static unsigned int     elapsed( int *expired );
+static void             program( void );
+static void             calibrate( void );
+static unsigned long long divide( unsigned long long n, unsigned long d );
+
+
+void hrtimer_init( void ) {
+/*************************/
+
+    calibrate();
+
+    next_tick = TICK_NS;
+    event = TICK_NS;
+    programmed = NS_PIT( TICK_NS );
+    pit_oneshot( programmed );
+    if( tsc_mult ) {
+        tsc_start = rdtsc();
+    }
+    enable_irq( TIMER_IRQ, 0 );
+}
+
+/*
+ * Reads the clock, in nanoseconds since hrtimer_init.
+ */
+unsigned long long hrclock( void ) {
+
+    int                 expired;
+
+    return hr_now + PIT_NS( elapsed( &expired ) );
+}
+
+/*
+ * Reads the clock from the TSC, in nanoseconds since hrtimer_init. The
+ * cycles are multiplied by tsc_mult in 32 bit halves, as there is no 64
+ * bit multiply to shift down from.
+ */
+unsigned long long gettime( void ) {
+
+    unsigned long long  c;
+    unsigned long       ch, cl, mh, ml;
+
+    if( !tsc_mult ) {
+        return hrclock();
+    }
+
+    c = rdtsc() - tsc_start;
+    ch = c >> 32;
+    cl = c;
+    mh = tsc_mult >> 32;
+    ml = tsc_mult;
+
+    return ( ( (unsigned long long) ch * mh ) << 32 )
+        + (unsigned long long) ch * ml + (unsigned long long) cl * mh
+        + ( ( (unsigned long long) cl * ml ) >> 32 );
+}
+
+/*
+ * Starts a high resolution timer. The timer must not already be
+ * running.
+ *
+ * Arguments:
+ *   t        - the timer, owned by the caller until it goes off or is
+ *              cancelled
+ *   deadline - hrclock time to go off at
+ *   slack    - nanoseconds it may go off late by
+ *   fn       - called with arg when the timer goes off
+ */
+void hrtimer_add( hrtimer *t, unsigned long long deadline,
+                  unsigned long slack, timerfn fn, void *arg ) {
+
+    hrtimer             *prev = NULL, *tmp;
+    unsigned int        e;
+    int                 expired;
+
+    t->deadline = deadline;
+    t->slack = slack;
+    t->fn = fn;
+    t->arg = arg;
+    t->queued = TRUE;
+
+    for( tmp = hr_head; tmp && tmp->deadline <= deadline; tmp = tmp->next ) {
+        prev = tmp;
+    }
+
+    t->prev = prev;
+    t->next = tmp;
+    if( tmp ) {
+        tmp->prev = t;
+    }
+    if( prev ) {
+        prev->next = t;
+    } else {
+        hr_head = t;
+    }
+
+    if( deadline + slack >= event ) {
+        return;
+    }
+
+    // Bring the PIT in if it is set for too late. If it has already
+    // gone off the interrupt will see to the timer.
+    e = elapsed( &expired );
+    if( !expired ) {
+        hr_now += PIT_NS( e );
+        program();
+    }
+}
+
+/*
+ * Stops a high resolution timer. The PIT is left as it is; if it goes
+ * off for this timer the interrupt finds nothing to do.
+ *
+ * Returns:
+ *    0 on success
+ *   -1 if the timer was not running
+ */
+int hrtimer_cancel( hrtimer *t ) {
+
+    if( !t->queued ) {
+        return -1;
+    }
+
+    if( t->prev ) {
+        t->prev->next = t->next;
+    } else {
+        hr_head = t->next;
+    }
+    if( t->next ) {
+        t->next->prev = t->prev;
+    }
+
+    t->next = NULL;
+    t->prev = NULL;
+    t->queued = FALSE;
+
+    return 0;
+}
+
+/*
+ * Called by the dispatcher on a timer interrupt. Brings the clock up to
+ * date, runs tick() for each tick that has passed and the functions of
+ * the high resolution timers that are due, then sets the PIT for the
+ * next of either.
+ *
+ * Returns:
+ *   the number of ticks that passed, 0 if the interrupt was only for
+ *   high resolution timers
+ */
+int hrtimer_interrupt( void ) {
+
+    hrtimer             *t;
+    int                 expired, n = 0;
+
+    hr_now += PIT_NS( elapsed( &expired ) );
+
+    while( hr_now >= next_tick ) {
+        next_tick += TICK_NS;
+        tick();
+        n++;
+    }
+
+    while( ( t = hr_head ) && t->deadline <= hr_now ) {
+        hrtimer_cancel( t );
+        t->fn( t->arg );
+    }
+
+    program();
+
+    return n;
+}
+
+/*
+ * PIT clocks since it was last set. Once it has reached zero the counter
+ * carries on down from 0xffff, so it can still be told how far past.
+ */
+static unsigned int elapsed( int *expired ) {
+
+    unsigned int        count = pit_read( expired );
+
+    if( *expired ) {
+        return programmed + ( ( 0x10000 - count ) & 0xffff );
+    }
+
+    return programmed - count;
+}
+
+/*
+ * Sets the PIT to go off at the next tick or the latest a high
+ * resolution timer may go off, whichever is first. hr_now must be the
+ * time now.
+ */
+static void program( void ) {
+
+    unsigned long long  next = next_tick;
+    hrtimer             *t;
+
+    // Timers after the first may still have less slack
+    for( t = hr_head; t && t->deadline < next; t = t->next ) {
+        if( t->deadline + t->slack < next ) {
+            next = t->deadline + t->slack;
+        }
+    }
+    event = next;
+
+    // The next tick is never more than TICK_NS away, so this fits
+    programmed = next > hr_now ? NS_PIT( (unsigned long)( next - hr_now ) ) : 0;
+    if( programmed < 1 ) {
+        programmed = 1;
+    }
+
+    pit_oneshot( programmed );
+}
+
+/*
+ * Times the TSC against the PIT to find tsc_mult. Leaves tsc_mult 0 if
+ * there is no TSC, or it is too fast or too slow to time this way.
+ */
+static void calibrate( void ) {
+
+    unsigned long long  start, cycles;
+    int                 expired;
+
+    tsc_mult = 0;
+    if( !has_tsc() ) {
+        return;
+    }
+
+    pit_oneshot( CALIBRATE_PIT );
+    start = rdtsc();
+    do {
+        pit_read( &expired );
+    } while( !expired );
+    cycles = rdtsc() - start;
+
+    if( cycles && !( cycles >> 32 ) ) {
+        tsc_mult = divide( (unsigned long long) PIT_NS( CALIBRATE_PIT ) << 32,
+                           cycles );
+    }
+}
+
+/*
+ * n / d, a bit at a time. There is no 64 bit divide without libgcc and
+ * this only runs once at boot.
+ */
+static unsigned long long divide( unsigned long long n, unsigned long d ) {
+
+    unsigned long long  q = 0, r = 0;
+    int                 i;
+
+    for( i = 63; i >= 0; i-- ) {
+        r = ( r << 1 ) | ( ( n >> i ) & 1 );
+        if( r >= d ) {
+            r -= d;
+            q |= 1ULL << i;
+        }
+    }
+
+    return q;
+}
@@ -34,15 +34,84 @@ long	initsp;		/* initial SP for init() */
 long    freemem;        /* start of free memory */
 char	*maxaddr;       /* end of memory space */
 
+memrange physmem[MAX_PHYS_RANGES];	/* usable memory, by address */
+int	nphysmem;
+
+static void addrange(unsigned long start, unsigned long end);
+
 
 
 /*------------------------------------------------------------------------
- * sizmem - return memory size (in pages)
+ * sizmem - find usable memory and return memory size (in pages)
+ *	Fills in physmem from the BIOS memory map left by setup.S. Without
+ *	one, falls back to the extended memory size setup.S also left.
  *------------------------------------------------------------------------
  */
 long sizmem(void)
 {
-        return 1024;
+	struct e820map	*m = E820_MAP;
+	struct e820entry *e;
+	unsigned long	start, end;
+	int		i;
+
+	nphysmem = 0;
+
+	if (m->sig == E820_SIG && m->nr <= E820_MAX) {
+		for (i = 0; i < m->nr; i++) {
+			e = &m->map[i];
+			if (e->type != E820_RAM || e->base_hi
+			    || e->base_lo >= MAX_PHYS)
+				continue;
+
+			start = e->base_lo;
+			if (e->len_hi || e->len_lo > MAX_PHYS - start)
+				end = MAX_PHYS;
+			else
+				end = start + e->len_lo;
+			addrange(start, end);
+		}
+	}
+
+	if (!nphysmem) {
+		addrange(0, HOLESTART);
+		addrange(0x100000, EXT_MEM_K ? 0x100000 + EXT_MEM_K * 1024
+					     : 4 * 1024 * 1024);
+	}
+
+	return physmem[nphysmem - 1].end / NBPG;
+}
+
+/*------------------------------------------------------------------------
+ * addrange - add whole pages of a usable range to physmem, keeping it
+ *	sorted and merging ranges that overlap or touch
+ *------------------------------------------------------------------------
+ */
+static void addrange(unsigned long start, unsigned long end)
+{
+	int	i, j;
+
+	start = (start + NBPG - 1) & ~(NBPG - 1);
+	end &= ~(NBPG - 1);
+	if (start >= end || nphysmem == MAX_PHYS_RANGES)
+		return;
+
+	for (i = 0; i < nphysmem && physmem[i].start < start; i++)
+		;
+	for (j = nphysmem; j > i; j--)
+		physmem[j] = physmem[j - 1];
+	physmem[i].start = start;
+	physmem[i].end = end;
+	nphysmem++;
+
+	for (i = 0, j = 1; j < nphysmem; j++) {
+		if (physmem[j].start <= physmem[i].end) {
+			if (physmem[j].end > physmem[i].end)
+				physmem[i].end = physmem[j].end;
+		} else {
+			physmem[++i] = physmem[j];
+		}
+	}
+	nphysmem = i + 1;
 }
 
 
@@ -64,13 +133,15 @@ void setsegs(void)
 	psd->sd_lolimit = np;
 	psd->sd_hilimit = np >> 16;
 
+	/* Data and stack span the whole address space, process stacks */
+	/* live above physical memory and paging decides what is there  */
 	psd = &gdt_copy[2];	/* kernel data segment */
-	psd->sd_lolimit = npages;
-	psd->sd_hilimit = npages >> 16;
+	psd->sd_lolimit = 0xffff;
+	psd->sd_hilimit = 0xf;
 
 	psd = &gdt_copy[3];	/* kernel stack segment */
-	psd->sd_lolimit = npages;
-	psd->sd_hilimit = npages >> 16;
+	psd->sd_lolimit = 0xffff;
+	psd->sd_hilimit = 0xf;
 
 	psd = &gdt_copy[4];	/* bootp code segment */
 	psd->sd_lolimit = npages;   /* Allows execution of 0x100000 CODE */
@@ -121,6 +192,86 @@ void initPIT( int divisor )
 }
 
 
+/*------------------------------------------------------------------------
+ * pit_oneshot - interrupt once, count timer clocks from now
+ *------------------------------------------------------------------------
+ */
+void pit_oneshot( unsigned int count )
+{
+        outb( TIMER_MODE, TIMER_SEL0 | TIMER_INTTC | TIMER_16BIT );
+        outb( TIMER_CNTR0, count & 0xff );
+        outb( TIMER_CNTR0, count >> 8 );
+}
+
+
+/*------------------------------------------------------------------------
+ * pit_read - read counter 0, and whether it has reached zero since
+ *            pit_oneshot. The counter keeps counting down past zero.
+ *------------------------------------------------------------------------
+ */
+unsigned int pit_read( int *expired )
+{
+        unsigned int    count;
+
+        outb( TIMER_MODE, TIMER_READBACK | TIMER_RB_CTR0 );
+        *expired = ( inb( TIMER_CNTR0 ) & TIMER_STAT_OUT ) != 0;
+        count = inb( TIMER_CNTR0 );
+        count |= inb( TIMER_CNTR0 ) << 8;
+
+        return count;
+}
+
+
+/*------------------------------------------------------------------------
+ * has_tsc - whether the CPU has a time stamp counter. CPUs without cpuid
+ *           cannot flip the ID bit in EFLAGS, and have no TSC either.
+ *------------------------------------------------------------------------
+ */
+int has_tsc( void )
+{
+        unsigned int    before, after, edx;
+
+        __asm __volatile( " \
+	pushfl \n\
+	popl	%0 \n\
+	movl	%0, %1 \n\
+	xorl	$0x200000, %1 \n\
+	pushl	%1 \n\
+	popfl \n\
+	pushfl \n\
+	popl	%1 \n\
+	pushl	%0 \n\
+	popfl \n\
+	"
+	: "=&r" (before), "=&r" (after)
+	:
+	: "cc"
+        );
+
+        if( !( ( before ^ after ) & 0x200000 ) ) {
+                return 0;
+        }
+
+        __asm __volatile( "cpuid" : "=d" (edx) : "a" (1) : "%ebx", "%ecx" );
+
+        return ( edx >> 4 ) & 1;
+}
+
+
+/*------------------------------------------------------------------------
+ * rdtsc - read the time stamp counter
+ *------------------------------------------------------------------------
+ */
+unsigned long long rdtsc( void )
+{
+        unsigned long long      tsc;
+
+        __asm __volatile( "rdtsc" : "=A" (tsc) );
+
+        return tsc;
+}
+
+
 /*------------------------------------------------------------------------
  * end_of_intr - signal EOI to rearm hardware interrupts
  *------------------------------------------------------------------------
@@ -8,12 +8,13 @@ extern	int	entry( void );  /* start of kernel image, use &start    */
 extern	int	end( void );    /* end of kernel image, use &end        */
 extern  long	freemem; 	/* start of free memory (set in i386.c) */
 extern char	*maxaddr;	/* max memory address (set in i386.c)	*/
+extern memrange	physmem[];	/* usable memory (set in i386.c)	*/
+extern int	nphysmem;
 
 static Bool word_equals(char *exp, char *act, int length);
 
 int idle_pid;
 int shell_pid;       /* pid we will alarm */
-int alarm_ticks;     /* ticks after we will alarm */
 
 /*------------------------------------------------------------------------
  *  The idle process
@@ -42,16 +43,24 @@ static void idleproc( void )
  */
 void initproc( void )				/* The beginning */
 {
+  int i;
+
   kprintf( "\n\nCPSC 415, 2016W1 \n32 Bit Xeros 0.01 \nLocated at: %x to %x\n",
 	   &entry, &end);
 
   /* Your code goes here */
 
   kprintf("Max addr is %d %x\n", maxaddr, maxaddr);
+  for (i = 0; i < nphysmem; i++) {
+    kprintf("Memory %x to %x\n", physmem[i].start, physmem[i].end);
+  }
 
-  kmeminit();
+  kmeminit(physmem, nphysmem);
   kprintf("memory inited\n");
 
+  paging_init();
+  kprintf("paging inited\n");
+
   dispatchinit();
   kprintf("dispatcher inited\n");
 
@@ -82,6 +91,9 @@ void initproc( void )				/* The beginning */
   //create( test_syswait, PROC_STACK );
   //create( run_signal_tests, PROC_STACK );
   //create( run_device_tests, PROC_STACK );
+  //create( run_memory_tests, PROC_STACK );
+  //create( run_timer_tests, PROC_STACK );
+  //create( sleepbench, PROC_STACK );
   //create( shell, PROC_STACK );
 
   create( init, PROC_STACK );
@@ -193,10 +205,13 @@ Bool word_equals(char *exp, char *act, int length) {
  * Possible commands are: 
  *
  *   ps
+ *   free - prints kernel memory usage
+ *   trace - prints live kernel allocations by call site (MEM_TRACE)
  *   ex - exists shell
  *   k [pid] - kills process with pid, if exists
  *   a [ticks] - sets an alarm or tick cpu quantums
  *   t - prints T evey 10 seconds
+ *   bench - measures how late sleeps end, see sleepbench.c
  *   m - prints Bloody Murder
  *   c [char] - Changes EOF to char until shell ends
  */
@@ -204,10 +219,12 @@ void shell( void ) {
   int fd = sysopen(1);
   char input[100];
   int ret, pid;
-  int child_index = 0;
-  int child_proc[50];
+  int children = 0;
   Bool repeat = TRUE;
 
+  // Children are reaped when the shell exits; until then SIGCHLD waits
+  syssigprocmask(SIG_BLOCK, 1 << SIGCHLD, NULL);
+
   while ( repeat ) {
     repeat = FALSE;
 
@@ -228,7 +245,7 @@ void shell( void ) {
         procs = sysgetcputimes(&psTab);
 
         
-        sysputs("\n PID      State          Time\n");
+        sysputs("\n PID      State        CPU us    Stack used/size       Mem  Group used/limit\n");
         for(j = 0; j <= procs; j++) {
 
           switch (psTab.status[j]) {
@@ -249,15 +266,64 @@ void shell( void ) {
             case ( STATE_READ ):
               sprintf(status, "%s", "READING");
               break;
+            case ( STATE_PAUSED ):
+              sprintf(status, "%s", " PAUSED");
+              break;
+            case ( STATE_SIGWAIT ):
+              sprintf(status, "%s", "SIGWAIT");
+              break;
             default:
               sprintf(status, "%s", "UNKNOWN");
           }
 
-          sprintf(buff, "%4d    %s    %10d\n", psTab.pid[j], status, 
-           psTab.cpuTime[j]);
+          sprintf(buff, "%4d    %s    %10d    %5d/%5d    %7d    %7d/%7d\n", psTab.pid[j], status, 
+           psTab.cpuTime[j], psTab.stackUsed[j], psTab.stackSize[j],
+           psTab.memUsed[j], psTab.groupUsed[j], psTab.memLimit[j]);
           kprintf(buff);
         }
 
+      } else if( word_equals("free", current, 4) ) {
+        meminfo mi;
+        int j;
+        char buff[500];
+        sysmeminfo(&mi);
+
+        sprintf(buff, "\n           total       free\n"
+                "low   %10d %10d\nhigh  %10d %10d\n",
+                mi.lowTotal, mi.lowFree, mi.highTotal, mi.highFree);
+        sysputs(buff);
+        sprintf(buff, "largest free block %d, free fragments %d\n"
+                "failed allocations %d, %d of them from fragmentation\n",
+                mi.largestFree, mi.fragments, mi.failures, mi.fragFailures);
+        sysputs(buff);
+
+        sysputs("\n PID     Blocks      Bytes\n");
+        for(j = 0; j < mi.owners; j++) {
+          if (mi.pid[j] < 0) {
+            sprintf(buff, "kern %10d %10d\n", mi.allocs[j], mi.bytes[j]);
+          } else {
+            sprintf(buff, "%4d %10d %10d\n", mi.pid[j], mi.allocs[j], mi.bytes[j]);
+          }
+          sysputs(buff);
+        }
+
+      } else if( word_equals("trace", current, 5) ) {
+        memsite sites[32];
+        int n, j;
+        char buff[500];
+
+        n = sysmemtrace(sites, 32);
+        if (n < 0) {
+          sysputs("Kernel built without MEM_TRACE.\n");
+        } else {
+          sysputs("\n  Caller   PID     Blocks      Bytes  Oldest tick\n");
+          for(j = 0; j < n; j++) {
+            sprintf(buff, "%8x  %4d %10d %10d %12d\n", sites[j].caller,
+                    sites[j].pid, sites[j].allocs, sites[j].bytes, sites[j].oldest);
+            sysputs(buff);
+          }
+        }
+
       } else if( word_equals("ex", current, 2) ) {
         sysclose(fd);
         sysputs("Exiting Shell. Goodbye.\n");
@@ -280,13 +346,16 @@ void shell( void ) {
         for( ; *current == ' '; current++);
         void (*oldhandler)(void *);
         syssighandler(15, alarm_handler, &oldhandler);
-        alarm_ticks = atoi(current);
-        pid = syscreate(alarm, 1024); 
-        child_proc[child_index++] = pid;
+        syssetitimer(15, atoi(current) * MILLISECONDS_TICK, 0);
 
       } else if( word_equals("t", current, 1) ) {
         pid = syscreate(t, 1024); 
-        child_proc[child_index++] = pid;
+        if ( pid != CREATE_FAILURE ) children++;
+
+      } else if( word_equals("bench", current, 5) ) {
+        pid = syscreate(sleepbench, 4096);
+        if ( pid != CREATE_FAILURE ) children++;
+        syswait(pid);
 
       } else if( word_equals("m", current, 1) ) {
         sysputs("Bloody Murder!\n");
@@ -320,10 +389,13 @@ void shell( void ) {
     }
   }
 
-  while ( child_index >= 0 ) {
-    ret = syswait(child_proc[child_index]);
-
-    if ( ret == 0 || ret == -1 ) child_index--; 
+  // Reap each child as it exits, sleeping in between
+  while ( children > 0 ) {
+    if ( syswaitany(NULL, NULL) >= 0 ) {
+      children--;
+    } else {
+      syssigwait(1 << SIGCHLD, NULL, NULL);
+    }
   }
 
   sysclose(fd);
@@ -341,20 +413,15 @@ void alarm_handler( void *cntx ) {
 }
 
 
-/*
- * alarm - alarm the shell after a given time
- */
-void alarm( void ) {
-  syssleep( alarm_ticks * MILLISECONDS_TICK );
-  syskill( shell_pid, 15 );
-}
-
 /*
  * t - t process prints T every 10 seconds or so
  */
 void t( void ) {
+  unsigned long when = sysgetticks();
+
   while ( 1 ) {
-    syssleep(10000);
+    when += 10000 / MILLISECONDS_TICK;
+    syssleepuntil(when);
     sysputs("\nT\n");
   }
 }
@@ -153,6 +153,12 @@ int kbd_read(pcb *proc, devsw *dev, void *buf, int buflen) {
 
   unsigned int *proc_buffer = (unsigned int *) buf;
 
+  // A process told of input by DEV_NOTIFY takes what there is, rather
+  // than waiting for the rest of its buffer
+  if ( dev->notify_pid == proc->pid && kernel_buflen && buflen > kernel_buflen ) {
+    buflen = kernel_buflen;
+  }
+
   if (buflen > kernel_buflen ) {
 
     blocked_read = proc;
@@ -205,6 +211,7 @@ int kbd_write(pcb *proc, devsw * dev, void *buf, int buflen) {
  *                                  char must be valid ASCII.
  *   command - 55 : turn echo off
  *   command - 56 : turn echo on
+ *   DEV_NOTIFY is taken by di_ioctl before it gets here
  *
  * Arguments
  *   the requesting process
@@ -266,6 +273,7 @@ void notify_incoming_intr( unsigned int scan ) {
   if (code == keyboard_state->end_of_file ) {
 
     if( blocked_read ) unblock_proc();
+    else dev_notify(current_keyboard);
     enable_irq(KEYBOARD_IRQ, 1);
     keyboard_state->disabled = TRUE;
   }
@@ -283,6 +291,7 @@ void notify_incoming_intr( unsigned int scan ) {
     kernel_buffer[kernel_buflen] = code;
     kernel_buflen++;
     if (keyboard_state->echo_on) kprintf("%c",code);
+    dev_notify(current_keyboard);
   }
 
 }
@@ -2,87 +2,929 @@
  */
 
 #include <xeroskernel.h>
+#include <xeroslib.h>
 #include <i386.h>
 
 /* Your code goes here */
 /*Why do you need a paragraph mask?*/
 #define PARAGRAPH_MASK  (~(0xf))
 
+/* Owner values for a block that are not process IDs */
+#define MEM_FREE        (-2)
+#define MEM_KERNEL      (-1)
+
+/* Mixed with a block's address to mark it as allocated */
+#define MEM_SANITY      0x5AFEB10C
+
+/* Most regions of memory the allocator manages, splitting around the */
+/* hole can turn one range of physical memory into two                */
+#define MAX_MEM_REGIONS (MAX_PHYS_RANGES + 1)
+
 extern long     freemem;
 
+/* Every block, free or allocated, starts with one of these. Free blocks */
+/* are kept on a list sorted by address so kfree can coalesce them.      */
 typedef struct struct_mem mem;
 struct struct_mem {
-    mem         *next;
-    mem         *prev;
-    int         size;
+    mem         *next;   /* Next free block, or sanity word if allocated */
+    mem         *prev;   /* Previous free block                          */
+    int         size;    /* Size of the block including this header      */
+    int         owner;   /* MEM_FREE, MEM_KERNEL or the owning PID       */
+};
+
+/* A contiguous run of memory, tiled with blocks from start to end */
+typedef struct struct_memregion memregion;
+struct struct_memregion {
+    mem         *start;
+    mem         *end;
 };
 
 static mem      *head;
+static memregion regions[MAX_MEM_REGIONS];
+static int      nregions;
+static int      failures;       /* kmalloc calls that found no block      */
+static int      fragFailures;   /* ... while enough was free in total     */
+
+#define MEM_SANE(p)     ((mem *)((unsigned long)(p) ^ MEM_SANITY))
+
+/* Memory accounting. Every process is in a group, and the stack pages */
+/* and heap arena chunks its members use are charged to the group.     */
+typedef struct struct_memgroup memgroup;
+struct struct_memgroup {
+    unsigned long used;         /* Bytes charged to the group's members   */
+    unsigned long limit;        /* Charges that would pass this fail      */
+    int         members;        /* Processes in the group, 0 if unused    */
+    int         leader;         /* Process the group was made for         */
+};
 
- void kmeminit( void ) {
+static memgroup groups[MAX_PROC];
+
+#ifdef MEM_TRACE
+/* Live allocations, only recorded when built with -DMEM_TRACE */
+#define MAX_TRACE       512
+
+typedef struct struct_trace trace;
+struct struct_trace {
+    void        *ptr;    /* The allocation, NULL if the slot is unused */
+    size_t      size;    /* Usable size of the block                   */
+    void        *caller; /* Return address of the allocating call      */
+    int         pid;     /* Owner, as set by kmemowner                 */
+    unsigned long tick;  /* When it was allocated                      */
+};
+
+static trace    traces[MAX_TRACE];
+static int      traceDropped;   /* allocations the table had no room for  */
+
+static void     trace_alloc( void *ptr, void *caller );
+static void     trace_free( void *ptr );
+static trace    *trace_find( void *ptr );
+
+#define TRACE_ALLOC(p)  trace_alloc( (p), __builtin_return_address( 0 ) )
+#define TRACE_FREE(p)   trace_free( (p) )
+#else
+#define TRACE_ALLOC(p)
+#define TRACE_FREE(p)
+#endif
+
+static void     *mem_alloc( size_t size );
+static void     mem_free( void *ptr );
+static void     count_failure( size_t size );
+static void     add_region( unsigned long start, unsigned long end );
+static size_t   block_size( size_t size );
+static void     *take( mem *p, size_t size );
+static void     unlink( mem *p, mem *r );
+static mem      *region_end( mem *b );
+
+/*
+ * Sets up the free list from the usable physical memory found at boot,
+ * leaving out the kernel and the hole.
+ *
+ * Arguments:
+ *   ranges  - usable memory, sorted by address
+ *   nranges - number of entries in ranges
+ */
+ void kmeminit( memrange *ranges, int nranges ) {
 /****************************/
 
-     long       s;
+     unsigned long      s, e, lo;
+     int                i;
 
-     s = ( freemem + 0x10 ) & PARAGRAPH_MASK;
+     lo = ( freemem + 0x10 ) & PARAGRAPH_MASK;
 
-     head = (mem *)s;
-     head->size = HOLESTART - s;
-     head->prev = NULL;
+     head = NULL;
+     nregions = 0;
 
-     s = HOLEEND;
+     for( i = 0; i < nranges; i++ ) {
+         s = ranges[i].start < lo ? lo : ranges[i].start;
+         e = ranges[i].end;
 
-     head->next = (mem *)s;
-     head->next->next = NULL;
-     head->next->prev = head;
-     head->next->size = (1024 * 1024 * 4) - HOLEEND;
+         if( s < HOLEEND && e > HOLESTART ) {
+             add_region( s, HOLESTART );
+             s = HOLEEND;
+         }
+         add_region( s, e );
+     }
 }
 
-void kfree(void * mem) {
+/*
+ * Makes [start, end) one free block at the end of the free list, if it
+ * is big enough to be worth having.
+ */
+static void add_region( unsigned long start, unsigned long end ) {
+
+    mem         *b = (mem *)start;
+    mem         *tail;
+
+    if( end <= start || end - start < 2 * sizeof( mem )
+        || nregions == MAX_MEM_REGIONS ) {
+        return;
+    }
+
+    b->size = end - start;
+    b->owner = MEM_FREE;
+    b->next = NULL;
+    b->prev = NULL;
+
+    if( head ) {
+        for( tail = head; tail->next; tail = tail->next );
+        tail->next = b;
+        b->prev = tail;
+    } else {
+        head = b;
+    }
+
+    regions[nregions].start = b;
+    regions[nregions].end = (mem *)end;
+    nregions++;
+}
+
+/*
+ * Returns a block from kmalloc to the free list, merging it with the
+ * free blocks on either side of it.
+ *
+ * Arguments:
+ *   ptr - pointer returned by kmalloc, NULL is ignored
+ */
+void kfree( void *ptr ) {
 
+    TRACE_FREE( ptr );
+    mem_free( ptr );
+}
+
+static void mem_free( void *ptr ) {
+
+    mem         *b;
+    mem         *p;
+    mem         *prev;
+
+    if( !ptr ) {
+        return;
+    }
+
+    b = (mem *)ptr - 1;
+    if( b->next != MEM_SANE( b ) || b->owner == MEM_FREE ) {
+        kprintf( "kfree: %x was not allocated by kmalloc\n", ptr );
+        return;
+    }
+
+    /* Find the free blocks on either side, by address */
+    prev = NULL;
+    for( p = head; p && p < b; p = p->next ) {
+        prev = p;
+    }
+
+    b->owner = MEM_FREE;
+    b->next = p;
+    b->prev = prev;
+
+    if( p ) {
+        p->prev = b;
+    }
+
+    if( prev ) {
+        prev->next = b;
+    } else {
+        head = b;
+    }
+
+    /* Merge with the block after */
+    if( p && (mem *)( (unsigned long)b + b->size ) == p ) {
+        b->size += p->size;
+        b->next = p->next;
+        if( b->next ) {
+            b->next->prev = b;
+        }
+    }
+
+    /* Merge with the block before */
+    if( prev && (mem *)( (unsigned long)prev + prev->size ) == b ) {
+        prev->size += b->size;
+        prev->next = b->next;
+        if( prev->next ) {
+            prev->next->prev = prev;
+        }
+    }
 }
 
 
  void *kmalloc( size_t size ) {
 /********************************/
 
+    void        *p = mem_alloc( size );
+
+    TRACE_ALLOC( p );
+    return( p );
+}
+
+/*
+ * First fit allocation for kmalloc and the functions built on it.
+ */
+static void *mem_alloc( size_t size ) {
+
     mem         *p;
-    mem         *r;
 
-    if( size & 0xf ) {
-        size = ( size + 0x10 ) & PARAGRAPH_MASK;
+    if( !size ) {
+        return( 0 );
     }
 
+    size = block_size( size );
+
     for( p = head; p && ( p->size < size ); p = p->next );
 
     if( !p ) {
+        count_failure( size );
+        return( 0 );
+    }
+
+    return( take( p, size ) );
+}
+
+/*
+ * Allocates memory whose address is a multiple of align. The space
+ * skipped to reach the alignment stays on the free list.
+ *
+ * Arguments:
+ *   align - required alignment, a power of two
+ *   size  - number of bytes wanted
+ *
+ * Returns:
+ *   the memory, NULL if size is 0, align is not a power of two or
+ *   there is no block it fits in
+ */
+void *kmemalign( size_t align, size_t size ) {
+
+    mem         *p;
+    mem         *b;
+    unsigned long u;
+    void        *ptr;
+
+    if( align & ( align - 1 ) ) {
+        return( 0 );
+    }
+
+    if( align <= 0x10 ) {
+        ptr = mem_alloc( size );
+        TRACE_ALLOC( ptr );
+        return( ptr );
+    }
+
+    if( !size ) {
+        return( 0 );
+    }
+
+    size = block_size( size );
+
+    for( p = head; p; p = p->next ) {
+        // First aligned address with room for a header in front of it.
+        // Blocks are paragraph aligned, so any space skipped before the
+        // header is big enough to be a free block.
+        u = ( (unsigned long)( p + 1 ) + align - 1 ) & ~( align - 1 );
+        b = (mem *)u - 1;
+
+        if( (unsigned long)b + size <= (unsigned long)p + p->size ) {
+            break;
+        }
+    }
+
+    if( !p ) {
+        count_failure( size + align );
+        return( 0 );
+    }
+
+    // Split off the padding in front as a free block of its own
+    if( b != p ) {
+        b->size = p->size - ( (unsigned long)b - (unsigned long)p );
+        b->owner = MEM_FREE;
+        b->prev = p;
+        b->next = p->next;
+        if( b->next ) {
+            b->next->prev = b;
+        }
+        p->next = b;
+        p->size -= b->size;
+    }
+
+    ptr = take( b, size );
+    TRACE_ALLOC( ptr );
+    return( ptr );
+}
+
+/*
+ * Resizes a block from kmalloc. Growing takes the free block that
+ * follows if it is big enough; only otherwise is the data copied to a
+ * new block. Shrinking gives the tail back to the free list.
+ *
+ * Arguments:
+ *   ptr  - block from kmalloc, or NULL to allocate a new one
+ *   size - new size in bytes, 0 frees the block
+ *
+ * Returns:
+ *   the resized block, which may have moved
+ *   NULL if there is no memory, in which case ptr is left alone
+ */
+void *krealloc( void *ptr, size_t size ) {
+
+    mem         *b;
+    mem         *n;
+    mem         *r;
+    void        *copy;
+
+    if( !ptr ) {
+        copy = mem_alloc( size );
+        TRACE_ALLOC( copy );
+        return( copy );
+    }
+
+    if( !size ) {
+        kfree( ptr );
         return( 0 );
     }
 
-    if( ( p->size - size ) < sizeof( mem ) ) {
-       if( p->next ) {
-            p->next->prev = p->prev;
+    b = (mem *)ptr - 1;
+    if( b->next != MEM_SANE( b ) || b->owner == MEM_FREE ) {
+        kprintf( "krealloc: %x was not allocated by kmalloc\n", ptr );
+        return( 0 );
+    }
+
+    size = block_size( size );
+
+    // Shrink, handing the tail to kfree so it merges with its neighbours
+    if( size <= b->size ) {
+        if( b->size - size > sizeof( mem ) ) {
+            r = (mem *)( (unsigned long)b + size );
+            r->size = b->size - size;
+            r->next = MEM_SANE( r );
+            r->owner = MEM_KERNEL;
+            b->size = size;
+            mem_free( r + 1 );
         }
+        TRACE_ALLOC( ptr );
+        return( ptr );
+    }
+
+    // Grow into the free block that follows, if it is in the same region
+    n = (mem *)( (unsigned long)b + b->size );
+    if( n != region_end( b ) && n->owner == MEM_FREE
+        && b->size + n->size >= size ) {
 
-        if( p->prev ) {
-            p->prev->next = p->next;
+        if( b->size + n->size - size > sizeof( mem ) ) {
+            r = (mem *)( (unsigned long)b + size );
+            *r = *n;
+            r->size -= size - b->size;
+            unlink( n, r );
+            b->size = size;
         } else {
-            head = p->next;
+            unlink( n, NULL );
+            b->size += n->size;
         }
+        TRACE_ALLOC( ptr );
+        return( ptr );
+    }
+
+    // Move it
+    copy = mem_alloc( size - sizeof( mem ) );
+    if( !copy ) {
+        return( 0 );
+    }
+
+    blkcopy( copy, ptr, b->size - sizeof( mem ) );
+    ( (mem *)copy - 1 )->owner = b->owner;
+    kfree( ptr );
+
+    TRACE_ALLOC( copy );
+    return( copy );
+}
+
+/*
+ * Records who a block from kmalloc belongs to, for sysmeminfo.
+ *
+ * Arguments:
+ *   ptr - pointer returned by kmalloc
+ *   pid - the owning process
+ */
+void kmemowner( void *ptr, int pid ) {
+
+    mem         *b = (mem *)ptr - 1;
+
+    if( ptr && b->next == MEM_SANE( b ) ) {
+        b->owner = pid;
+#ifdef MEM_TRACE
+        if( trace_find( ptr ) ) {
+            trace_find( ptr )->pid = pid;
+        }
+#endif
+    }
+}
+
+/*
+ * Size of the block needed for a request of size bytes: the request
+ * plus a header, rounded up to a paragraph.
+ */
+static size_t block_size( size_t size ) {
+
+    size += sizeof( mem );
+    if( size & 0xf ) {
+        size = ( size + 0x10 ) & PARAGRAPH_MASK;
+    }
+
+    return size;
+}
+
+/*
+ * Allocates the first size bytes of free block p, leaving the rest of
+ * it on the free list if it is big enough to be a block.
+ *
+ * Returns:
+ *   the memory after p's header
+ */
+static void *take( mem *p, size_t size ) {
+
+    mem         *r;
+
+    if( ( p->size - size ) <= sizeof( mem ) ) {
+        unlink( p, NULL );
     } else {
-        r = (mem *) ( (int)p + size );
+        r = (mem *) ( (unsigned long)p + size );
         *r = *p;
+        r->size -= size;
+        unlink( p, r );
+        p->size = size;
+    }
+
+    p->next = MEM_SANE( p );
+    p->prev = NULL;
+    p->owner = MEM_KERNEL;
+
+    return( p + 1 );
+}
 
-        if( p->next ) {
-            p->next->prev = r;
+/*
+ * Takes free block p off the free list. If r is not NULL it takes p's
+ * place on the list; its next and prev must already be p's.
+ */
+static void unlink( mem *p, mem *r ) {
+
+    mem         *next = r ? r : p->next;
+    mem         *prev = r ? r : p->prev;
+
+    if( p->next ) {
+        p->next->prev = prev;
+    }
+
+    if( p->prev ) {
+        p->prev->next = next;
+    } else {
+        head = next;
+    }
+}
+
+/*
+ * Finds the end of the region a block is in.
+ */
+static mem *region_end( mem *b ) {
+
+    int         r;
+
+    for( r = 0; r < nregions; r++ ) {
+        if( b >= regions[r].start && b < regions[r].end ) {
+            return regions[r].end;
         }
+    }
+
+    return b;
+}
+
+/*
+ * Counts a failed kmalloc, noting whether there was enough memory free
+ * in total, meaning the heap is too fragmented rather than exhausted.
+ */
+static void count_failure( size_t size ) {
+
+    mem         *p;
+    size_t      total = 0;
+
+    failures++;
+
+    for( p = head; p; p = p->next ) {
+        total += p->size;
+    }
 
-        if( p->prev ) {
-            p->prev->next = r;
+    if( total >= size ) {
+        fragFailures++;
+    }
+}
+
+/*
+ * The system side of sysmeminfo. Walks every block in every region and
+ * fills in mi with how much memory is free on each side of the hole,
+ * how fragmented the free memory is and who the allocations belong to.
+ *
+ * Arguments:
+ *   proc - the process asking
+ *   mi   - structure to fill in
+ *
+ * Returns:
+ *   -1 if mi is in the hole
+ *   -2 if mi goes beyond the end of main memory or is in the stack
+ *      region outside proc's stack
+ *    0 on success
+ */
+int getmeminfo( pcb *proc, meminfo *mi ) {
+
+    mem         *p;
+    int         r, i;
+
+    if( ((unsigned long) mi) >= HOLESTART && ((unsigned long) mi <= HOLEEND) ) {
+        return -1;
+    }
+
+    if( !user_range_ok( proc, mi, sizeof( meminfo ) ) ) {
+        return -2;
+    }
+
+    memset( mi, 0, sizeof( meminfo ) );
+    mi->failures = failures;
+    mi->fragFailures = fragFailures;
+
+    for( r = 0; r < nregions; r++ ) {
+        unsigned long *total, *free;
+
+        if( (unsigned long) regions[r].start < HOLESTART ) {
+            total = &mi->lowTotal;
+            free = &mi->lowFree;
         } else {
-            head = r;
+            total = &mi->highTotal;
+            free = &mi->highFree;
+        }
+
+        *total += (unsigned long)regions[r].end
+                  - (unsigned long)regions[r].start;
+
+        for( p = regions[r].start; p < regions[r].end;
+             p = (mem *)( (unsigned long)p + p->size ) ) {
+
+            if( p->size <= 0 ) {
+                kprintf( "getmeminfo: heap corrupt at %x\n", p );
+                break;
+            }
+
+            if( p->owner == MEM_FREE ) {
+                *free += p->size;
+                mi->fragments++;
+                if( p->size > mi->largestFree ) {
+                    mi->largestFree = p->size;
+                }
+                continue;
+            }
+
+            for( i = 0; i < mi->owners && mi->pid[i] != p->owner; i++ );
+            if( i == mi->owners ) {
+                if( i == MAX_PROC + 1 ) {
+                    continue;
+                }
+                mi->pid[i] = p->owner;
+                mi->owners++;
+            }
+            mi->allocs[i]++;
+            mi->bytes[i] += p->size;
         }
     }
 
-    return( p );
+    return 0;
+}
+
+/*
+ * Puts a new process in a group of its own, with the default limit.
+ * There is always a free group as there are as many groups as process
+ * table entries.
+ *
+ * Arguments:
+ *   p - the process being created
+ */
+void kmemgroup( pcb *p ) {
+
+    int         g;
+
+    for( g = 0; g < MAX_PROC && groups[g].members; g++ );
+
+    groups[g].used = 0;
+    groups[g].limit = MEM_QUOTA;
+    groups[g].members = 1;
+    groups[g].leader = p->pid;
+
+    p->memGroup = g;
+    p->memUsed = 0;
+}
+
+/*
+ * Moves a process into another process's group, taking what it has
+ * been charged so far with it.
+ *
+ * Arguments:
+ *   p      - the process to move
+ *   leader - a process in the group to join
+ *
+ * Returns:
+ *    0 on success
+ *   -1 if the move would take the group over its limit
+ */
+int kmemjoin( pcb *p, pcb *leader ) {
+
+    memgroup    *g = &groups[leader->memGroup];
+
+    if( p->memGroup == leader->memGroup ) {
+        return 0;
+    }
+
+    if( g->used + p->memUsed > g->limit ) {
+        return -1;
+    }
+
+    kmemleave( p );
+    g->used += p->memUsed;
+    g->members++;
+    p->memGroup = leader->memGroup;
+
+    return 0;
+}
+
+/*
+ * Takes an exiting process out of its group. Anything it is still
+ * charged for stops counting against the group.
+ */
+void kmemleave( pcb *p ) {
+
+    memgroup    *g = &groups[p->memGroup];
+
+    g->used -= p->memUsed;
+    g->members--;
+}
+
+/*
+ * Charges memory to a process and its group.
+ *
+ * Arguments:
+ *   p     - the process using the memory
+ *   bytes - how much it is using
+ *   force - charge even if it takes the group over its limit
+ *
+ * Returns:
+ *    0 on success
+ *   -1 if the group would go over its limit, nothing is charged
+ */
+int kmemcharge( pcb *p, unsigned long bytes, Bool force ) {
+
+    memgroup    *g = &groups[p->memGroup];
+
+    if( !force && g->used + bytes > g->limit ) {
+        return -1;
+    }
+
+    g->used += bytes;
+    p->memUsed += bytes;
+
+    return 0;
+}
+
+/*
+ * Gives back memory charged with kmemcharge.
+ */
+void kmemuncharge( pcb *p, unsigned long bytes ) {
+    groups[p->memGroup].used -= bytes;
+    p->memUsed -= bytes;
+}
+
+/*
+ * Reports what a process's group uses and may use, for ps.
+ */
+void kmemusage( pcb *p, unsigned long *groupUsed, unsigned long *limit ) {
+    *groupUsed = groups[p->memGroup].used;
+    *limit = groups[p->memGroup].limit;
+}
+
+/*
+ * The system side of syssetmemlimit. Sets the limit of the group a
+ * process is in. Lowering it below what the group already uses makes
+ * further charges fail but takes nothing away. Only the process the
+ * group was made for may raise the limit; any other process may only
+ * lower it, and only for itself or a process it created, directly or
+ * not, so a quota cannot be lifted from inside it.
+ *
+ * Arguments:
+ *   caller - the process setting the limit
+ *   pid    - a process in the group
+ *   limit  - the new limit in bytes
+ *
+ * Returns:
+ *    0 on success
+ *   -1 if there is no such process
+ *   -2 if the caller may not change the limit that way
+ */
+int setmemlimit( pcb *caller, int pid, unsigned long limit ) {
+
+    pcb         *p = findPCB( pid );
+    pcb         *a;
+    memgroup    *g;
+
+    if( !p ) {
+        return -1;
+    }
+
+    g = &groups[p->memGroup];
+
+    if( limit > g->limit ) {
+        if( caller->pid != g->leader ) {
+            return -2;
+        }
+    } else {
+        for( a = p; a && a != caller; a = findPCB( a->ppid ) );
+        if( !a ) {
+            return -2;
+        }
+    }
+
+    g->limit = limit;
+
+    return 0;
+}
+
+/*
+ * The system side of sysmemtrace. Groups the live allocations recorded
+ * by a MEM_TRACE build by call site and owner.
+ *
+ * Arguments:
+ *   p     - the process asking
+ *   sites - table to fill in
+ *   max   - number of entries in sites
+ *
+ * Returns:
+ *   -1 if sites is in the hole
+ *   -2 if sites goes beyond the end of main memory or is in the stack
+ *      region outside p's stack
+ *   -3 if the kernel was built without MEM_TRACE
+ *   otherwise the number of entries filled in
+ */
+int getmemtrace( pcb *p, memsite *sites, int max ) {
+
+#ifdef MEM_TRACE
+    trace       *t;
+    int         i, n = 0;
+#endif
+
+    if( max < 0 ) {
+        max = 0;
+    }
+
+    if( ((unsigned long) sites) >= HOLESTART && ((unsigned long) sites <= HOLEEND) ) {
+        return -1;
+    }
+
+#ifdef MEM_TRACE
+    // There are never more sites than traces
+    if( max > MAX_TRACE ) {
+        max = MAX_TRACE;
+    }
+#endif
+
+    if( !user_range_ok( p, sites, max * sizeof( memsite ) ) ) {
+        return -2;
+    }
+
+#ifdef MEM_TRACE
+    for( t = traces; t < &traces[MAX_TRACE]; t++ ) {
+        if( !t->ptr ) {
+            continue;
+        }
+
+        for( i = 0; i < n && ( sites[i].caller != t->caller
+                               || sites[i].pid != t->pid ); i++ );
+        if( i == n ) {
+            if( n == max ) {
+                continue;
+            }
+            sites[i].caller = t->caller;
+            sites[i].pid = t->pid;
+            sites[i].allocs = 0;
+            sites[i].bytes = 0;
+            sites[i].oldest = t->tick;
+            n++;
+        }
+
+        sites[i].allocs++;
+        sites[i].bytes += t->size;
+        if( t->tick < sites[i].oldest ) {
+            sites[i].oldest = t->tick;
+        }
+    }
+
+    return n;
+#else
+    return -3;
+#endif
+}
+
+/*
+ * Reports allocations a process still owns once everything it holds
+ * has been released. Only a MEM_TRACE build knows about them.
+ *
+ * Arguments:
+ *   pid - the process that is exiting
+ *
+ * Returns:
+ *   the number of leaked allocations
+ */
+int kmemcheck( int pid ) {
+
+    int         leaks = 0;
+#ifdef MEM_TRACE
+    trace       *t;
+
+    for( t = traces; t < &traces[MAX_TRACE]; t++ ) {
+        if( t->ptr && t->pid == pid ) {
+            kprintf( "Process %d leaked %d bytes at %x, allocated by %x at tick %d\n",
+                     pid, t->size, t->ptr, t->caller, t->tick );
+            leaks++;
+        }
+    }
+#endif
+
+    return leaks;
+}
+
+#ifdef MEM_TRACE
+/*
+ * Records a new or resized allocation, taking the size and owner from
+ * its header.
+ */
+static void trace_alloc( void *ptr, void *caller ) {
+
+    trace       *t;
+    mem         *b = (mem *)ptr - 1;
+
+    if( !ptr ) {
+        return;
+    }
+
+    t = trace_find( ptr );
+    if( !t ) {
+        t = trace_find( NULL );
+    }
+    if( !t ) {
+        if( !traceDropped++ ) {
+            kprintf( "MEM_TRACE table full, allocations go untraced\n" );
+        }
+        return;
+    }
+
+    t->ptr = ptr;
+    t->size = b->size - sizeof( mem );
+    t->caller = caller;
+    t->pid = b->owner;
+    t->tick = ticks;
+}
+
+static void trace_free( void *ptr ) {
+
+    trace       *t = ptr ? trace_find( ptr ) : NULL;
+
+    if( t ) {
+        t->ptr = NULL;
+    }
+}
+
+/*
+ * Finds the entry for ptr, or a free entry if ptr is NULL.
+ */
+static trace *trace_find( void *ptr ) {
+
+    trace       *t;
+
+    for( t = traces; t < &traces[MAX_TRACE]; t++ ) {
+        if( t->ptr == ptr ) {
+            return t;
+        }
+    }
+
+    return NULL;
 }
+#endif
@@ -0,0 +1,476 @@
+/* paging.c : paging and demand-allocated process stacks
+ *
+ * Physical memory is identity mapped so the kernel runs as it did before
+ * paging was turned on. Above it is a region of STACK_VSIZE slots, one
+ * per process table entry. A process's stack is the top of its slot; the
+ * page below the stack and everything under it is left unmapped as a
+ * guard. Stack pages get a physical page the first time they are
+ * touched, filled with STACK_FILL so stack_used still works. Each page
+ * is charged to the process's memory group when it is mapped.
+ *
+ * Page faults are taken through a task gate. The processor switches to
+ * the fault task's own stack before pushing anything, so a process that
+ * runs into its guard page faults cleanly instead of double faulting.
+ *
+ * - void paging_init( void );
+ *     Build the page tables and turn paging on
+ *
+ * - void *stack_reserve( pcb *p, size_t size );
+ *     Reserve a stack in p's slot
+ *
+ * - void stack_release( pcb *p );
+ *     Give back every page of p's stack
+ *
+ * - Bool page_mapped( void *addr );
+ *     Check whether addr has a physical page behind it
+ *
+ * - Bool user_range_ok( pcb *p, void *addr, unsigned long len );
+ *     Check that a buffer p passed to a system call is its to pass
+ *
+ * - Bool stack_strayed( void );
+ *     Check whether a system call touched a bad address in the stack
+ *     region, and take back the page it was given
+ */
+
+#include <xeroskernel.h>
+#include <xeroslib.h>
+#include <i386.h>
+
+/* Pages taken from kmalloc at a time to hand out as stack pages */
+#define FRAME_BATCH     8
+
+/* GDT slots of the two task state segments */
+#define KERNEL_TSS      (5 * 8)
+#define FAULT_TSS       (6 * 8)
+
+/* Selectors startup.S loads into the data and stack segments */
+#define KERNEL_DS       0x10
+#define KERNEL_SS       0x18
+
+#define PAGE_FAULT      14
+
+/* Words of stack the fault task runs on */
+#define FAULT_STACK     1024
+
+#define CR0_PG          0x80000000
+
+
+extern struct sd gdt[];
+extern char     *maxaddr;
+extern void     Xpagefault( void );
+
+static unsigned long    *page_dir;
+static unsigned long    stack_base;     /* Start of the stack region      */
+static unsigned long    *frame_free;    /* Free pages, linked by 1st word */
+static unsigned long    stray;          /* Page lent for a bad address    */
+static Bool             strayed;        /* Set when one has been lent     */
+
+static struct tss       kernel_tss;
+static struct tss       fault_tss;
+static unsigned long    fault_stack[FAULT_STACK];
+
+
+/* Internal Helpers */
+void                    pagefault( unsigned long error );
+static void             fault_exit( void );
+static void             *frame_alloc( void );
+static void             frame_put( void *frame );
+static unsigned long    *page_entry( unsigned long addr );
+static unsigned long    *make_entry( unsigned long addr );
+static pcb              *stack_owner( unsigned long addr );
+static unsigned long    stack_top( pcb *p );
+static void             set_tss( struct sd *psd, struct tss *t );
+static Bool             stray_map( unsigned long addr );
+static void             flush_tlb( void );
+
+
+void paging_init( void ) {
+/*************************/
+
+    unsigned long       a, end;
+
+    page_dir = frame_alloc();
+    memset( page_dir, 0, NBPG );
+
+    // Identity map physical memory, a whole page table at a time
+    end = ( (unsigned long)maxaddr + PG_SPAN ) & ~( PG_SPAN - 1 );
+    for( a = 0; a < end; a += NBPG ) {
+        *make_entry( a ) = a | PG_PRESENT | PG_WRITE;
+    }
+
+    // The stack region starts after it. Its page tables are made now
+    // so a fault never has to. maxaddr stays the end of physical memory;
+    // user_range_ok lets a process pass pointers into its own stack.
+    stack_base = end;
+    end = stack_base + MAX_PROC * STACK_VSIZE;
+    for( a = stack_base; a < end; a += PG_SPAN ) {
+        make_entry( a );
+    }
+
+    // The processor saves the running kernel into kernel_tss when a
+    // fault switches it to fault_tss, and iret switches it back
+    kernel_tss.cr3 = (unsigned long)page_dir;
+    kernel_tss.iomap = sizeof( struct tss );
+
+    fault_tss.cr3 = (unsigned long)page_dir;
+    fault_tss.eip = (unsigned long)Xpagefault;
+    fault_tss.eflags = 0x2;                     /* interrupts off */
+    fault_tss.esp = (unsigned long)&fault_stack[FAULT_STACK];
+    fault_tss.cs = getCS();
+    fault_tss.ds = fault_tss.es = KERNEL_DS;
+    fault_tss.fs = fault_tss.gs = KERNEL_DS;
+    fault_tss.ss = KERNEL_SS;
+    fault_tss.iomap = sizeof( struct tss );
+
+    set_tss( &gdt[KERNEL_TSS / 8], &kernel_tss );
+    set_tss( &gdt[FAULT_TSS / 8], &fault_tss );
+    set_taskgate( PAGE_FAULT, FAULT_TSS );
+
+    __asm __volatile( "ltr %%ax" : : "a" (KERNEL_TSS) );
+    __asm __volatile( "movl %0, %%cr3" : : "r" (page_dir) );
+    __asm __volatile( " \
+        movl    %%cr0, %%eax \n\
+        orl     %0, %%eax \n\
+        movl    %%eax, %%cr0 \n\
+        "
+        :
+        : "i" (CR0_PG)
+        : "%eax"
+    );
+}
+
+/*
+ * Reserves a stack of size bytes at the top of p's slot in the stack
+ * region. No memory is used until the stack is touched.
+ *
+ * Arguments:
+ *   p    - the process being created
+ *   size - stack size, a multiple of NBPG
+ *
+ * Returns:
+ *   the lowest address of the stack
+ *   NULL if the stack and its guard page do not fit in a slot
+ */
+void *stack_reserve( pcb *p, size_t size ) {
+
+    if( size > STACK_VSIZE - NBPG ) {
+        return NULL;
+    }
+
+    return (void *)( stack_top( p ) - size );
+}
+
+/*
+ * Unmaps every page of a process's stack and keeps them for the next
+ * stack that needs one.
+ *
+ * Arguments:
+ *   p - the exiting process
+ */
+void stack_release( pcb *p ) {
+
+    unsigned long       a, *pte;
+
+    for( a = (unsigned long)p->stack; a < stack_top( p ); a += NBPG ) {
+        pte = page_entry( a );
+        if( *pte & PG_PRESENT ) {
+            frame_put( (void *)( *pte & PG_FRAME ) );
+            kmemuncharge( p, NBPG );
+            *pte = 0;
+        }
+    }
+
+    // Flush the TLB so the old mappings are forgotten
+    flush_tlb();
+}
+
+/*
+ * Checks whether an address has a physical page behind it, so stack
+ * pages can be inspected without faulting them in.
+ */
+Bool page_mapped( void *addr ) {
+
+    unsigned long       *pte = page_entry( (unsigned long)addr );
+
+    return pte && ( *pte & PG_PRESENT );
+}
+
+/*
+ * Checks that a buffer a process passed to a system call is one the
+ * kernel may use for it: in physical memory and not in the hole, or
+ * inside the process's own stack. The rest of the stack region is other
+ * processes' stacks, guard pages and free slots.
+ *
+ * Arguments:
+ *   p    - the process making the call
+ *   addr - the start of the buffer
+ *   len  - its length in bytes
+ *
+ * Returns:
+ *   TRUE if the whole buffer is the process's to pass
+ */
+Bool user_range_ok( pcb *p, void *addr, unsigned long len ) {
+
+    unsigned long       a = (unsigned long)addr;
+    unsigned long       end = a + len;
+
+    if( end < a || a < NBPG ) {
+        return FALSE;
+    }
+
+    if( a >= stack_base ) {
+        return p->stack && a >= (unsigned long)p->stack && end <= stack_top( p );
+    }
+
+    if( end > (unsigned long)maxaddr + 1 ) {
+        return FALSE;
+    }
+
+    return end <= HOLESTART || a > HOLEEND;
+}
+
+/*
+ * Called by the dispatcher after each system call. A call that touched
+ * an address in the stack region it had no page for was lent one so the
+ * kernel could finish; the page is taken back here.
+ *
+ * Returns:
+ *   TRUE if a page was lent, and the caller should be stopped
+ */
+Bool stack_strayed( void ) {
+
+    Bool                was = strayed;
+
+    stray_map( 0 );
+    strayed = FALSE;
+
+    return was;
+}
+
+/*
+ * Called by the fault task with the processor's error code. A missing
+ * page in a process's stack gets a fresh page, unless that takes the
+ * process's group over its memory limit. Any other fault stops the
+ * process that was running; a fault in the kernel halts it.
+ */
+void pagefault( unsigned long error ) {
+
+    unsigned long       addr;
+    void                *frame;
+    pcb                 *p;
+    Bool                kernel;
+
+    __asm __volatile( "movl %%cr2, %0" : "=r" (addr) );
+
+    // The kernel touching a stack, as create does, always gets its
+    // page; it has nothing to stop
+    kernel = !stack_owner( kernel_tss.esp );
+
+    p = stack_owner( addr );
+    if( p && !( error & PF_PROTECT ) && addr >= (unsigned long)p->stack ) {
+        if( kmemcharge( p, NBPG, kernel ) < 0 ) {
+            kprintf( "Process %d is over its memory limit, stopping it\n",
+                     p->pid );
+        } else if( ( frame = frame_alloc() ) ) {
+            memset( frame, STACK_FILL, NBPG );
+            *page_entry( addr ) = (unsigned long)frame | PG_PRESENT | PG_WRITE;
+            return;
+        } else {
+            kmemuncharge( p, NBPG );
+        }
+    }
+
+    // Processes run on their stacks in the stack region, the kernel
+    // never does. A kernel fault there is a bad pointer passed to a
+    // system call: the kernel is lent a page to finish the call with,
+    // and the dispatcher stops the caller.
+    p = stack_owner( kernel_tss.esp );
+    if( !p && addr >= stack_base && addr < stack_base + MAX_PROC * STACK_VSIZE
+        && stray_map( addr ) ) {
+        return;
+    }
+    if( !p ) {
+        kprintf( "Kernel page fault at %x, eip %x, error %x\n",
+                 addr, kernel_tss.eip, error );
+        kprintf( "\nHalting.....\n" );
+        for(;;);
+    }
+
+    if( stack_owner( addr ) == p && addr < (unsigned long)p->stack ) {
+        kprintf( "Stack overflow in process %d, stopping it\n", p->pid );
+        p->stackHWM = p->stackSize;
+    } else {
+        kprintf( "Page fault at %x in process %d, stopping it\n",
+                 addr, p->pid );
+    }
+
+    // Resume the process at the top of its stack, in a function that
+    // stops it
+    kernel_tss.esp = stack_top( p ) - 16;
+    kernel_tss.ebp = kernel_tss.esp;
+    kernel_tss.eip = (unsigned long)fault_exit;
+}
+
+/*
+ * Where a process that took a fatal page fault is sent to die.
+ */
+static void fault_exit( void ) {
+    sysstop();
+}
+
+/*
+ * Takes a free physical page, carving a new batch out of the kernel
+ * allocator when there are none left.
+ *
+ * Returns:
+ *   a page aligned page, NULL if the kernel is out of memory
+ */
+static void *frame_alloc( void ) {
+
+    unsigned long       *f;
+    unsigned long       a;
+    int                 i;
+
+    if( !frame_free ) {
+        a = (unsigned long)kmemalign( NBPG, FRAME_BATCH * NBPG );
+        if( !a ) {
+            return NULL;
+        }
+
+        for( i = 0; i < FRAME_BATCH; i++ ) {
+            frame_put( (void *)( a + i * NBPG ) );
+        }
+    }
+
+    f = frame_free;
+    frame_free = (unsigned long *)*f;
+
+    return f;
+}
+
+static void frame_put( void *frame ) {
+    *(unsigned long *)frame = (unsigned long)frame_free;
+    frame_free = frame;
+}
+
+/*
+ * Finds the page table entry for an address.
+ *
+ * Returns:
+ *   the entry, NULL if there is no page table for the address
+ */
+static unsigned long *page_entry( unsigned long addr ) {
+
+    unsigned long       pde = page_dir[addr / PG_SPAN];
+
+    if( !( pde & PG_PRESENT ) ) {
+        return NULL;
+    }
+
+    return (unsigned long *)( pde & PG_FRAME ) + ( addr / NBPG ) % PG_ENTRIES;
+}
+
+/*
+ * Finds the page table entry for an address, making the page table
+ * first if there is none. Only used while the kernel is starting, when
+ * there is always memory for a page table.
+ */
+static unsigned long *make_entry( unsigned long addr ) {
+
+    unsigned long       *pt;
+
+    if( !page_entry( addr ) ) {
+        pt = frame_alloc();
+        memset( pt, 0, NBPG );
+        page_dir[addr / PG_SPAN] = (unsigned long)pt | PG_PRESENT | PG_WRITE;
+    }
+
+    return page_entry( addr );
+}
+
+/*
+ * Finds the process whose stack slot holds an address.
+ *
+ * Returns:
+ *   the process, NULL if the address is not in the slot of a process
+ *   that has a stack
+ */
+static pcb *stack_owner( unsigned long addr ) {
+
+    pcb                 *p;
+
+    if( addr < stack_base || addr >= stack_base + MAX_PROC * STACK_VSIZE ) {
+        return NULL;
+    }
+
+    p = &proctab[( addr - stack_base ) / STACK_VSIZE];
+
+    return p->stack ? p : NULL;
+}
+
+static unsigned long stack_top( pcb *p ) {
+    return stack_base + ( p - proctab + 1 ) * STACK_VSIZE;
+}
+
+/*
+ * Lends the kernel a page at addr in place of the one it last lent, or
+ * with an addr of 0 just takes that one back.
+ *
+ * Returns:
+ *   FALSE if there is no page to lend
+ */
+static Bool stray_map( unsigned long addr ) {
+
+    unsigned long       *pte;
+    void                *frame;
+
+    if( stray ) {
+        pte = page_entry( stray );
+        frame_put( (void *)( *pte & PG_FRAME ) );
+        *pte = 0;
+        stray = 0;
+        flush_tlb();
+    }
+
+    if( !addr ) {
+        return TRUE;
+    }
+
+    if( !( frame = frame_alloc() ) ) {
+        return FALSE;
+    }
+
+    stray = addr & PG_FRAME;
+    *page_entry( stray ) = (unsigned long)frame | PG_PRESENT | PG_WRITE;
+    strayed = TRUE;
+
+    return TRUE;
+}
+
+static void flush_tlb( void ) {
+    __asm __volatile( " \
+        movl    %%cr3, %%eax \n\
+        movl    %%eax, %%cr3 \n\
+        "
+        :
+        :
+        : "%eax"
+    );
+}
+
+/*
+ * Fills in a GDT descriptor for a task state segment.
+ */
+static void set_tss( struct sd *psd, struct tss *t ) {
+
+    unsigned long       base = (unsigned long)t;
+
+    memset( psd, 0, sizeof( struct sd ) );
+    psd->sd_lolimit = sizeof( struct tss ) - 1;
+    psd->sd_lobase = base;
+    psd->sd_midbase = base >> 16;
+    psd->sd_hibase = base >> 24;
+    psd->sd_type = SDT_TSS & 0x7;
+    psd->sd_iscode = SDT_TSS >> 3;
+    psd->sd_present = 1;
+}
@@ -10,6 +10,13 @@
 
 extern char *maxaddr;
 
+/* Internal Helpers */
+static void interrupt(pcb *proc);
+static int  default_action(pcb *proc, int sig_no);
+static int  take_value(pcb *proc, int sig_no);
+static void notify(pcb *proc, int sig_no);
+static void sigwait_take(pcb *proc, int sig_no);
+
 /*
  * Sends a signal No. to a specified process
  *
@@ -35,16 +42,285 @@ int signal(int pid, int sig_no) {
     return -2;
   }
 
-  // If signal has no hander, ignore signal
+  // If signal has no hander, take its default action, which for most
+  // is to ignore it
   // According to https://piazza.com/class/isp6lqkqfq32kx?cid=314
-  if ( proc->sig_handlers[sig_no] == NULL ) return 0;
+  if ( default_action(proc, sig_no) ) return 0;
+
+  // set the bit for this signal
+  proc->signals |= 1 << sig_no;
+  notify(proc, sig_no);
+  return 0;
+}
+
+/*
+ * Queues a signal with a value for a specified process. Unlike signal,
+ * every one sent is delivered, in the order they were sent, and the
+ * handler is passed the value.
+ *
+ * Arguments:
+ *   - pid of the process we want to signal
+ *   - signal number for that process
+ *   - value passed to the handler
+ *
+ * Returns
+ *   -1 if the process is invalid
+ *   -2 if the signal is invalid
+ *   -3 if the process has SIGQUEUE_MAX signals queued already
+ *    0 otherwise
+ */
+int sigqueue(int pid, int sig_no, int value) {
+  pcb *proc = findPCB( pid );
+
+  if ( !proc ) {
+    return -1;
+  }
+
+  if ( sig_no < 0 || sig_no >= MAX_SIGNALS ) {
+    return -2;
+  }
+
+  if ( default_action(proc, sig_no) ) return 0;
+
+  if ( proc->sigCount == SIGQUEUE_MAX ) {
+    return -3;
+  }
+
+  proc->sigQueued[proc->sigCount] = sig_no;
+  proc->sigValues[proc->sigCount] = value;
+  proc->sigCount++;
+
+  proc->signals |= 1 << sig_no;
+  notify(proc, sig_no);
+  return 0;
+}
+
+/*
+ * Changes the signals a process blocks. Blocked signals stay pending
+ * and are delivered once they are unblocked.
+ *
+ * Arguments:
+ *   Process whose mask to change
+ *   SIG_BLOCK to add mask to the blocked signals, SIG_UNBLOCK to take
+ *   it away, or SIG_SETMASK to block exactly mask
+ *   Mask with a bit set for each signal
+ *   Where to put the old mask, or NULL
+ *
+ * Returns
+ *   -1 if how is invalid
+ *   -2 if oldmask is at an invalid address
+ *    0 on success
+ */
+int sigprocmask(pcb *proc, int how, unsigned int mask, unsigned int *oldmask) {
+
+  if ( how != SIG_BLOCK && how != SIG_UNBLOCK && how != SIG_SETMASK ) {
+    return -1;
+  }
+
+  if ( oldmask ) {
+    if ( ((unsigned long) oldmask >= HOLESTART) && ((unsigned long) oldmask <= HOLEEND) ) {
+      return -2;
+    }
+    if ( !user_range_ok( proc, oldmask, sizeof( unsigned int ) ) ) {
+      return -2;
+    }
+    *oldmask = proc->sigMask;
+  }
+
+  if ( how == SIG_BLOCK ) {
+    proc->sigMask |= mask;
+  } else if ( how == SIG_UNBLOCK ) {
+    proc->sigMask &= ~mask;
+  } else {
+    proc->sigMask = mask;
+  }
+
+  // A SIGTERM kept pending while blocked, with no handler to take it,
+  // stops the process once it is unblocked
+  if ( (((proc->signals & ~proc->sigMask) >> SIGTERM) & 1) && !proc->sig_handlers[SIGTERM] ) {
+    terminate(proc, SIGTERM);
+  }
+
+  return 0;
+}
 
+/*
+ * Takes a pending signal in a set as a return value, without running a
+ * handler, or blocks the process until one is sent. The signals are
+ * best blocked with sigprocmask, so that ones sent between calls wait
+ * for the next call rather than going to a handler or being ignored.
+ * The highest pending signal is taken first, and a queued signal gives
+ * up its values oldest first, as they would be delivered.
+ *
+ * Arguments:
+ *   Process that is waiting
+ *   Mask with a bit set for each signal to wait for
+ *   Where to put the signal taken, or NULL
+ *   Where to put its value, or NULL
+ *
+ * Sets the process's return value to
+ *   -1 if the mask is empty or sig or value is at an invalid address
+ *    0 once a signal has been taken
+ *
+ * Returns
+ *   TRUE if the process blocked
+ *   FALSE otherwise
+ */
+Bool sigwait(pcb *proc, unsigned int mask, int *sig, int *value) {
+  int *out[2];
+  int i, sig_no;
+
+  out[0] = sig;
+  out[1] = value;
+  for ( i = 0; i < 2; i++ ) {
+    if ( !out[i] ) continue;
+    if ( ((unsigned long) out[i] >= HOLESTART) && ((unsigned long) out[i] <= HOLEEND) ) {
+      proc->ret = -1;
+      return FALSE;
+    }
+    if ( !user_range_ok( proc, out[i], sizeof( int ) ) ) {
+      proc->ret = -1;
+      return FALSE;
+    }
+  }
+
+  if ( !mask ) {
+    proc->ret = -1;
+    return FALSE;
+  }
+
+  proc->sigWaitMask = mask;
+  proc->sigWaitSig = sig;
+  proc->sigWaitValue = value;
+
+  for ( sig_no = MAX_SIGNALS - 1; sig_no >= 0; sig_no-- ) {
+    if ( ((proc->signals & mask) >> sig_no) & 1 ) {
+      sigwait_take(proc, sig_no);
+      return FALSE;
+    }
+  }
+
+  proc->state = STATE_SIGWAIT;
+  return TRUE;
+}
+
+/*
+ * Hands a signal to a process in sigwait as its return value.
+ */
+static void sigwait_take(pcb *proc, int sig_no) {
+  int value = take_value(proc, sig_no);
+
+  if ( proc->sigWaitSig ) *proc->sigWaitSig = sig_no;
+  if ( proc->sigWaitValue ) *proc->sigWaitValue = value;
+  proc->sigWaitMask = 0;
+  proc->ret = 0;
+}
+
+/*
+ * Sets the stack a process's signal handlers run on, so they do not
+ * need room on the process's own stack. The stack is memory the
+ * process owns, a static array or from sysmalloc.
+ *
+ * Arguments:
+ *   Process to set the stack for
+ *   Lowest address of the stack, NULL to run handlers on the process's
+ *   own stack again
+ *   Size of the stack in bytes
+ *
+ * Returns
+ *   -1 if the stack is at an invalid address
+ *   -2 if the stack is smaller than SIGSTACK_MIN
+ *   -3 if called from a handler, which may be running on the old stack
+ *    0 on success
+ */
+int sigaltstack(pcb *proc, void *stack, int size) {
+
+  if ( proc->processing ) {
+    return -3;
+  }
+
+  if ( stack ) {
+    if ( size < SIGSTACK_MIN ) {
+      return -2;
+    }
+    if ( ((unsigned long) stack + size > HOLESTART) && ((unsigned long) stack < HOLEEND) ) {
+      return -1;
+    }
+    if ( !user_range_ok( proc, stack, size ) ) {
+      return -1;
+    }
+  }
+
+  proc->sigStack = stack;
+  proc->sigStackSize = stack ? size : 0;
+  return 0;
+}
+
+/*
+ * Carries out what a signal does apart from running a handler. SIGKILL
+ * and SIGSTOP act at once, whatever the process's handlers and mask.
+ * SIGCONT lets a stopped process go on and then is handled like any
+ * other. SIGTERM stops a process with no handler for it, and any other
+ * signal with no handler is ignored, unless it is blocked or waited for
+ * with sigwait.
+ *
+ * Returns
+ *   TRUE if that is all the signal does
+ *   FALSE if it is to be delivered to a handler
+ */
+static int default_action(pcb *proc, int sig_no) {
+
+  switch ( sig_no ) {
+  case ( SIGKILL ):
+    terminate(proc, SIGKILL);
+    return TRUE;
+
+  case ( SIGSTOP ):
+    suspend(proc);
+    return TRUE;
+
+  case ( SIGCONT ):
+    resume(proc);
+    break;
+  }
+
+  if ( proc->sig_handlers[sig_no] ) return FALSE;
+
+  // With no handler, a signal the process blocks or is waiting for in
+  // sigwait is kept for sigwait to take
+  if ( (proc->sigMask >> sig_no) & 1 ) return FALSE;
+  if ( proc->state == STATE_SIGWAIT && ((proc->sigWaitMask >> sig_no) & 1) ) return FALSE;
+
+  if ( sig_no == SIGTERM ) terminate(proc, SIGTERM);
+  return TRUE;
+}
+
+/*
+ * Tells a process a signal has been made pending. A process waiting for
+ * it in sigwait takes it there and then; otherwise a process blocked in
+ * a system call is woken to run the handler, unless the signal is
+ * blocked, when it waits without waking the process.
+ */
+static void notify(pcb *proc, int sig_no) {
+
+  if ( proc->state == STATE_SIGWAIT && ((proc->sigWaitMask >> sig_no) & 1) ) {
+    sigwait_take(proc, sig_no);
+    ready(proc);
+  } else if ( !((proc->sigMask >> sig_no) & 1) ) {
+    interrupt(proc);
+  }
+}
+
+/*
+ * Wakes a process blocked in a system call so it can take a signal.
+ */
+static void interrupt(pcb *proc) {
 
   if ( proc->state == STATE_SLEEP ) {
     //remove from sleeping queue
-    int ticks_left = removeFromSleep(proc);
+    // syssleep and sysnanosleep return this as an unsigned int
+    proc->ret = (int) removeFromSleep(proc);
     proc->state = STATE_READY;
-    proc->ret = ticks_left * MILLISECONDS_TICK;
     ready( proc );
   }
 
@@ -56,15 +332,49 @@ int signal(int pid, int sig_no) {
     ready(proc);
   }
  
+  if ( proc->state == STATE_SIGWAIT ) {
+    proc->sigWaitMask = 0;
+    proc->ret = -2;
+    ready(proc);
+  }
+
   if ( proc->state == STATE_READ ) {  
     //Remove from blocked read
     unblock_proc();
     if (proc->ret <= 0 ) proc->ret = -362;
   }
+}
 
-  // set the bit for this signal
-  proc->signals |= 1 << sig_no;
-  return 0;
+/*
+ * Takes the oldest queued value of a signal that is being delivered.
+ * The signal stays pending while it has more queued.
+ *
+ * Returns
+ *   the value, 0 if the signal was sent by signal rather than queued
+ */
+static int take_value(pcb *proc, int sig_no) {
+  int i, value = 0, found = 0, more = 0;
+
+  for ( i = 0; i < proc->sigCount; i++ ) {
+    if ( proc->sigQueued[i] != sig_no ) continue;
+
+    if ( found ) {
+      more = 1;
+      break;
+    }
+
+    value = proc->sigValues[i];
+    found = 1;
+    proc->sigCount--;
+    blkcopy( &proc->sigQueued[i], &proc->sigQueued[i + 1], 
+             ( proc->sigCount - i ) * sizeof( int ) );
+    blkcopy( &proc->sigValues[i], &proc->sigValues[i + 1], 
+             ( proc->sigCount - i ) * sizeof( int ) );
+    i--;
+  }
+
+  if ( !more ) proc->signals &= ~(1 << sig_no);
+  return value;
 }
 
 /*
@@ -76,16 +386,19 @@ int signal(int pid, int sig_no) {
  *   Pointer to a variable that points to the old handler.
  *
  * Returns
- *   -1 if signal is invalid
+ *   -1 if signal is invalid or is SIGKILL or SIGSTOP
  *   -2 if the handler resides at an invalid address
  *    0 on success
  */
 int sighandler(pcb *proc, int signal, void (*newHandler)(void *), void (** oldHandler)(void *)) {
 
-  // signal number is invalid
+  // signal number is invalid, or one that cannot be handled
   if ( signal < 0 || signal > MAX_SIGNALS ) {
     return -1;
   }
+  if ( signal == SIGKILL || signal == SIGSTOP ) {
+    return -1;
+  }
 
   // memory locations for handlers are invalid
   if ( newHandler < 0 || ((char *) newHandler) > maxaddr ) {
@@ -102,63 +415,150 @@ int sighandler(pcb *proc, int signal, void (*newHandler)(void *), void (** oldHa
 }
 
 /*
- * Calls the signal handler and returns to the old context
+ * Posts a process's interval timer signal and starts the timer again if
+ * it repeats. The next expiry is counted from when this one was due, not
+ * from now, so a late tick does not push the rest back.
+ */
+static void itimer_expired(void *arg) {
+  pcb *proc = arg;
+
+  if ( proc->itimerInterval ) {
+    proc->itimerWhen += proc->itimerInterval;
+    timer_add_at( &proc->itimer, proc->itimerWhen,
+                  proc->timerSlack / ( MILLISECONDS_TICK * 1000000 ),
+                  itimer_expired, proc );
+  }
+
+  signal( proc->pid, proc->itimerSig );
+}
+
+/*
+ * Sets a process's interval timer, replacing the one it had. The timer
+ * is kernel state in the pcb, it does not need a process to sleep and
+ * then send the signal.
+ *
+ * Arguments:
+ *   Process to set the timer for
+ *   Signal to post when it goes off
+ *   Milliseconds until it first goes off, 0 stops the timer
+ *   Milliseconds between each time after, 0 for only once
+ *
+ * Returns
+ *   -1 if the signal is invalid
+ *   the milliseconds that were left on the old timer, 0 if none
+ */
+int setitimer(pcb *proc, int sig_no, unsigned int initial, unsigned int interval) {
+  int left;
+
+  if ( sig_no < 0 || sig_no >= MAX_SIGNALS ) {
+    return -1;
+  }
+
+  left = timer_cancel( &proc->itimer );
+  left = left < 0 ? 0 : left * MILLISECONDS_TICK;
+
+  if ( !initial ) return left;
+
+  // Round up so the timer never goes off early, but keep it periodic
+  proc->itimerSig = sig_no;
+  proc->itimerInterval = ( interval + MILLISECONDS_TICK - 1 ) / MILLISECONDS_TICK;
+  proc->itimerWhen = ticks + ( initial + MILLISECONDS_TICK - 1 ) / MILLISECONDS_TICK;
+  timer_add_at( &proc->itimer, proc->itimerWhen,
+                proc->timerSlack / ( MILLISECONDS_TICK * 1000000 ),
+                itimer_expired, proc );
+
+  return left;
+}
+
+/*
+ * Calls the handlers for a batch of signals, in order, and returns to
+ * the old context. Handlers are declared to take the context, but may
+ * take the value sent with syssigqueue as a second argument; with the
+ * caller cleaning up the arguments a handler that does not want it can
+ * ignore it.
  *
  * Arguments:
- *   Handler for that signal
- *   Context for that handler
+ *   Handlers to call, each with the value sent with its signal, 0 if
+ *   it was sent by syskill
+ *   Number of handlers
+ *   Context for the handlers
  */
-void sigtramp(void (* handler)(void *), void *cntx) {
-  // Call the signal handler
-  handler(cntx);
+void sigtramp(sigentry *list, int n, void *cntx) {
+  int i;
+
+  // Call the signal handlers
+  for ( i = 0; i < n; i++ ) {
+    ((void (*)(void *, int)) list[i].handler)(cntx, list[i].value);
+  }
 
   // return to the old stack pointer
   syssigreturn(cntx);
 }
 
 /*
- * Setup the process stack for sigtramp and sigtramp context
+ * Setup the process stack for sigtramp and sigtramp context. Every
+ * pending signal that is not blocked is taken at once, highest first,
+ * and sigtramp runs all their handlers before it returns to the kernel,
+ * so a burst of signals is handled with one trip through the kernel
+ * rather than one for each. Signals sent while the handlers run wait
+ * for the next trip.
  *
  * Argument:
  *  Process to be setup to handle a signal
+ *
+ * Returns
+ *  the number of handlers set up to run, 0 if there were none
  */
-void setup_sigtramp(pcb *proc) {
+int setup_sigtramp(pcb *proc) {
+
+  sigentry list[MAX_SIGNALS + SIGQUEUE_MAX];
+  int n = 0, signal, value;
 
-  // Figure out the signal we want to handle
-  int signal;
+  // Take the signals in priority order, leaving blocked ones. A queued
+  // signal stays pending until each of its values has been taken.
   for ( signal = MAX_SIGNALS - 1; signal >= 0; signal-- ) {
-    // if the bit for signal is set, we've found the highest priority signal
-    if ( (proc->signals >> signal) & 1 ) {
-      // clear the signal because we are handling it
-      proc->signals &= ~(1 << signal);
-      break;
+    while ( ((proc->signals & ~proc->sigMask) >> signal) & 1 ) {
+      value = take_value(proc, signal);
+
+      // If there is no handler for this signal we can ignore the signal
+      if ( proc->sig_handlers[signal] ) {
+        list[n].handler = proc->sig_handlers[signal];
+        list[n].value = value;
+        n++;
+      }
     }
   }
 
-  // Get that signal handler
-  void *handler = proc->sig_handlers[signal];
-
-
-  // If there is no handler for this signal we can ignore the signal
-  if ( !handler ) return;
+  if ( !n ) return 0;
 
   // Save the old sp
   int *old_sp = (int *) proc->esp;
 
-  // setup stack
+  // setup stack, on the alternate stack if the process has one
   unsigned int *sp = (unsigned int *) old_sp;
+  if ( proc->sigStack ) {
+    sp = (unsigned int *) (((unsigned long) proc->sigStack + proc->sigStackSize) & ~3);
+  }
 
-  // Push old return code to save it
-  sp--;
-  *sp = proc->ret;
+  // Save old return code, for sigreturn
+  proc->sigRet = proc->ret;
+
+  // Copy the handlers to run for sigtramp
+  sp -= n * sizeof(sigentry) / sizeof(int);
+  blkcopy( sp, list, n * sizeof(sigentry) );
+  sigentry *entries = (sigentry *) sp;
 
   // Push old sp to save it
   sp--;
   *sp = (int)old_sp;
 
-  // Push handler param for sigtramp
+  // Push the number of handlers for sigtramp
+  sp--;
+  *sp = n;
+
+  // Push the handlers param for sigtramp
   sp--;
-  *sp = (int)handler;
+  *sp = (int)entries;
 
   // Push return addr for sigtramp
   sp--;
@@ -181,4 +581,5 @@ void setup_sigtramp(pcb *proc) {
   sigtramp_ctx->eflags = STARTING_EFLAGS | ARM_INTERRUPTS;
 
   proc->esp = sp;
+  return n;
 }
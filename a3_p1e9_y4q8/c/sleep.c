@@ -7,35 +7,31 @@
 
 
 
-pcb	*sleepQ;
+unsigned long	ticks;
 
 
 // Len is the length of time to sleep
 
 
-/* This function works by mainting a delta list. This is where
-   each element in the list has as its key a value that is its difference
-   from the previous value. For example if we had the values 3, 7, 8, and 15 
-   to put in a list a list with their actual values would look like:
-       3->7->8->15   As a delta list this would be stored as:
-       3->4->1->7    To get the value of a node we sum all the preceding 
-                     values along with the value in that node. If these 
-   values represent how long into the future to sleep then all we have to do
-   is decrement the value of the head of the list on each tick. When that value
-   gets to 0 the time has expired and we remove it from the list. The value 
-   value of the element now at the head of the list represents how much 
-   additional time has to elapse before that time expires.
-
-   see: http://everything2.com/title/delta+list for additional information
+/* Each process has a kernel timer that is started when it sleeps. When
+   the timer goes off the process is made ready again; a process woken
+   early by a signal or killed has its timer cancelled. Timers are kept
+   in a timing wheel (see timer.c), so going to sleep and being woken
+   early take the same time however many processes are asleep.
+
+   sysnanosleep uses a high resolution timer (see hrtimer.c) instead, so
+   the sleep is not rounded to a tick.
+
+   Either timer may go off up to the process's timer slack late, which
+   lets the timer code wake processes with nearby deadlines together.
 */
 
+static void	wake( void *arg );
+
 
 void	sleep( pcb *p, unsigned int len ) {
 /****************************************/
 
-    pcb	*tmp;
-
-
     if( len < 1 ) {
         ready( p );
         return;
@@ -48,110 +44,82 @@ void	sleep( pcb *p, unsigned int len ) {
     p->state = STATE_SLEEP;
     p->next = NULL;
     p->prev = NULL;
-    if( !sleepQ ) { /* Empty sleep list */
-        sleepQ = p;
-        p->sleepdiff = len;
-    } else if( sleepQ->sleepdiff > len ) { /* Add to front */
-        p->next = sleepQ;
-        sleepQ->sleepdiff -= len;
-        p->sleepdiff = len;
-        sleepQ = p;
-    } else {  /* Goes after the head of the queue */
-        len -= sleepQ->sleepdiff;
-
-	/* Look for the spot in the sleep queue where this belongs */
-        for( tmp = sleepQ; tmp->next; tmp = tmp->next ) {
-            if( len < tmp->next->sleepdiff ) {
-	      break; /* goes in front of next element */
-            } else {
-	      /* goes after next element, so update the time difference */
-              /* and check the next element                             */
-	      len -= tmp->next->sleepdiff;
-            }
-        }
-
-	
-        p->next = tmp->next;
-        p->prev = tmp;
-        p->sleepdiff = len;
-        tmp->next = p;
-        
-	if( p->next ) { /* Not at that end of the list so insert it */
-            p->next->prev = p;
-            p->next->sleepdiff -= len;
-        }
+    timer_add( &p->sleepTimer, len,
+               p->timerSlack / ( MILLISECONDS_TICK * 1000000 ), wake, p );
+}
+
+void	nanosleep( pcb *p, unsigned int ns ) {
+/*******************************************/
+
+    if( ns < 1 ) {
+        ready( p );
+        return;
     }
+
+    p->state = STATE_SLEEP;
+    p->next = NULL;
+    p->prev = NULL;
+    hrtimer_add( &p->hrSleep, hrclock() + ns, p->timerSlack, wake, p );
+}
+
+void	sleepuntil( pcb *p, unsigned long when ) {
+/***********************************************/
+
+    if( when <= ticks ) {
+        ready( p );
+        return;
+    }
+
+    p->state = STATE_SLEEP;
+    p->next = NULL;
+    p->prev = NULL;
+    timer_add_at( &p->sleepTimer, when,
+                  p->timerSlack / ( MILLISECONDS_TICK * 1000000 ), wake, p );
 }
 
 /*
- * Removes p from SleepQ. 
+ * Removes p from the sleeping processes.
  *
- * Returns number of ticks until p should wake
+ * Returns the time left until p should have woken, in milliseconds for
+ * syssleep and nanoseconds for sysnanosleep. A nanosleep is at most an
+ * unsigned int of nanoseconds, so what is left of it fits in one, but
+ * not always in an int.
  */
-int removeFromSleep(pcb * p) {
+unsigned int removeFromSleep(pcb * p) {
 
-  int result = 0;
+  unsigned long long now;
+  int result;
 
-  if (!sleepQ) {
-    kprintf("Sleep queue corrupt, empty when it shouldn't be\n");
-    return 0;
+  if (p->hrSleep.queued) {
+    now = hrclock();
+    hrtimer_cancel( &p->hrSleep );
+    return p->hrSleep.deadline > now ? p->hrSleep.deadline - now : 0;
   }
-    
-  result = sleepQ->sleepdiff;
-
-  if (sleepQ == p) { // At front of list
-    sleepQ = p->next;
-    if (sleepQ != NULL) { // adjust sleep time
-      kprintf("Sleep values are %d %d\n", sleepQ->sleepdiff, p->sleepdiff);
-      sleepQ->sleepdiff = sleepQ->sleepdiff +  p->sleepdiff;
-      kprintf("Front sleeping process %d for %d\n", sleepQ->pid, sleepQ->sleepdiff);
-    } else {
-      kprintf("Only thing on sleep q\n");
-    }
-  } else {  // Not at front, find the process.
-    pcb * prev = sleepQ;
-    pcb * curr;
-    
-    for (curr = sleepQ->next; curr!=NULL; curr = curr->next) {
-      result += curr->sleepdiff;
-      if (curr == p) { // Found process so remove it
-	    prev->next = p->next;
-	    if (prev->next != NULL) {
-	      prev->next->sleepdiff = prev->next->sleepdiff +  p->sleepdiff;
-	      kprintf("Sleeping pid %d differential %d\n", prev->next->pid, prev->next->sleepdiff);
-	      p->next = NULL; // just to clean things up
-	    } else {
-	      kprintf("Sleeping %d was last process on list\n", curr->pid);
-	    }
-	    break;
-      }
-        prev = curr;
-    }
-    if (curr == NULL) {
-      kprintf("Sleep queue corrupt, process claims on queue and not found\n");
-    }
+
+  result = timer_cancel( &p->sleepTimer );
+
+  if (result < 0) {
+    kprintf("Process %d claims to be asleep and has no timer\n", p->pid);
+    return 0;
   }
 
-  return result;
+  return result * MILLISECONDS_TICK;
 }
 
 extern void tick( void ) {
 /****************************/
 
-    pcb	*tmp;
+    ticks++;
+    timer_tick();
+}
 
-    if( !sleepQ ) {
-        return;
-    }
+/*
+ * Called when a sleeping process's timer goes off.
+ */
+static void wake( void *arg ) {
 
-    for( sleepQ->sleepdiff--; sleepQ && !sleepQ->sleepdiff; ) {
-        tmp = sleepQ;
-        sleepQ = tmp->next;
+    pcb	*p = arg;
 
-        tmp->state = STATE_READY;
-        tmp->next = NULL;
-        tmp->prev = NULL;
-        tmp->ret = 0;
-        ready( tmp );
-    }
+    p->ret = 0;
+    ready( p );
 }
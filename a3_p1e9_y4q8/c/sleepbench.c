@@ -0,0 +1,176 @@
+/* sleepbench.c : sleep accuracy benchmark
+ *
+ * Measures how late processes wake from syssleep and sysnanosleep. For
+ * each load, some spinning processes that never give up the CPU, and
+ * each sleep length, a few sleepers sleep over and over at once and time
+ * every sleep with sysgettime. A sleep that ends early counts as 0 late
+ * and in the early column. A table of how late they woke, in
+ * percentiles, is printed to the console at the end of each load.
+ *
+ * It is run by the shell's "bench" command, or at boot from root().
+ *
+ * - void sleepbench( void );
+ *     Run every case and print the results
+ */
+
+#include <xeroskernel.h>
+#include <xeroslib.h>
+
+#define BENCH_SLEEPERS  4                       /* Asleep at once per case  */
+#define BENCH_SAMPLES   25                      /* Sleeps each one does     */
+#define BENCH_MAX       ( BENCH_SLEEPERS * BENCH_SAMPLES )
+#define BENCH_SPINNERS  3                       /* Most spinners at once    */
+
+typedef struct struct_benchcase benchcase;
+struct struct_benchcase {
+  char         *name;
+  int           nano;                           /* sysnanosleep, not syssleep */
+  unsigned int  len;                            /* ns if nano, else ms      */
+};
+
+static benchcase bench_cases[] = {
+  { "syssleep     10ms", 0, 10 },
+  { "syssleep     35ms", 0, 35 },
+  { "syssleep    100ms", 0, 100 },
+  { "nanosleep     1ms", 1, 1000000 },
+  { "nanosleep   2.5ms", 1, 2500000 },
+};
+#define BENCH_CASES     ( sizeof( bench_cases ) / sizeof( bench_cases[0] ) )
+
+static int bench_loads[] = { 0, 1, BENCH_SPINNERS };
+#define BENCH_LOADS     ( sizeof( bench_loads ) / sizeof( bench_loads[0] ) )
+
+static benchcase       *bench_case;             /* Case being run           */
+static int              sleeper_pids[BENCH_SLEEPERS];
+static unsigned long    late[BENCH_MAX];        /* us late, by sleeper      */
+static int              early[BENCH_SLEEPERS];  /* Sleeps that ended early  */
+
+
+/* Internal Helpers */
+static void             bench_sleeper( void );
+static void             bench_spinner( void );
+static void             run_case( benchcase *c );
+static void             report( int load, benchcase *c );
+
+
+void sleepbench( void ) {
+/***********************/
+
+  int spinners[BENCH_SPINNERS];
+  int l, c, j;
+
+  sysputs("\nSleep accuracy, us late over requested\n");
+
+  for( l = 0; l < BENCH_LOADS; l++ ) {
+    for( j = 0; j < bench_loads[l]; j++ ) {
+      spinners[j] = syscreate(bench_spinner, 1024);
+    }
+
+    sysputs("\nspin  call             samples   p50   p90   p99   max early\n");
+    for( c = 0; c < BENCH_CASES; c++ ) {
+      run_case( &bench_cases[c] );
+      report( bench_loads[l], &bench_cases[c] );
+    }
+
+    for( j = 0; j < bench_loads[l]; j++ ) {
+      syskillproc(spinners[j]);
+    }
+  }
+}
+
+/*
+ * Starts the sleepers for a case and waits for them all to finish.
+ */
+static void run_case( benchcase *c ) {
+
+  int j;
+
+  bench_case = c;
+  memset( early, 0, sizeof( early ) );
+  memset( late, 0, sizeof( late ) );
+  memset( sleeper_pids, 0, sizeof( sleeper_pids ) );
+
+  for( j = 0; j < BENCH_SLEEPERS; j++ ) {
+    sleeper_pids[j] = syscreate(bench_sleeper, 2048);
+  }
+  for( j = 0; j < BENCH_SLEEPERS; j++ ) {
+    syswait(sleeper_pids[j]);
+  }
+}
+
+/*
+ * Sleeps the current case's length BENCH_SAMPLES times, writing how
+ * late each sleep was into its own part of late.
+ */
+static void bench_sleeper( void ) {
+
+  unsigned long long  want, start, took;
+  unsigned long      *mine;
+  int                 pid = sysgetpid();
+  int                 slot = -1;
+  int                 j;
+
+  // The creator may be preempted before it has stored every pid
+  while( slot < 0 ) {
+    for( j = 0; j < BENCH_SLEEPERS; j++ ) {
+      if ( sleeper_pids[j] == pid ) slot = j;
+    }
+    if ( slot < 0 ) sysyield();
+  }
+  mine = &late[slot * BENCH_SAMPLES];
+
+  want = bench_case->nano ? bench_case->len
+                          : bench_case->len * 1000000ULL;
+
+  for( j = 0; j < BENCH_SAMPLES; j++ ) {
+    start = sysgettime();
+    if ( bench_case->nano ) {
+      sysnanosleep(bench_case->len);
+    } else {
+      syssleep(bench_case->len);
+    }
+    took = sysgettime() - start;
+
+    if ( took < want ) {
+      early[slot]++;
+    } else if ( ( took - want ) >> 32 ) {
+      mine[j] = 0xffffffffUL / 1000;
+    } else {
+      mine[j] = (unsigned long)( took - want ) / 1000;
+    }
+  }
+}
+
+/*
+ * Uses all the CPU it is given until it is killed.
+ */
+static void bench_spinner( void ) {
+  for( ;; );
+}
+
+/*
+ * Sorts a case's results and prints a row of percentiles.
+ */
+static void report( int load, benchcase *c ) {
+
+  char          buff[200];
+  unsigned long v;
+  int           i, j, e = 0;
+
+  for( i = 0; i < BENCH_SLEEPERS; i++ ) {
+    e += early[i];
+  }
+
+  for( i = 1; i < BENCH_MAX; i++ ) {
+    v = late[i];
+    for( j = i; j > 0 && late[j - 1] > v; j-- ) {
+      late[j] = late[j - 1];
+    }
+    late[j] = v;
+  }
+
+  sprintf(buff, "%4d  %s %7d %5d %5d %5d %5d %5d\n", load, c->name,
+          BENCH_MAX, late[BENCH_MAX * 50 / 100], late[BENCH_MAX * 90 / 100],
+          late[BENCH_MAX * 99 / 100], late[BENCH_MAX - 1], e);
+  sysputs(buff);
+}
@@ -18,10 +18,32 @@
  * - void syssigreturn(void *old_sp);
  *      kernel only when return from signal handling code
  *
+ * - int syssigprocmask(int how, unsigned int mask, unsigned int *oldmask);
+ *      blocks or unblocks signals, which stay pending while blocked
+ *
+ * - int syssigqueue(int pid, int signalNumber, int value);
+ *      signals a process with a value for its handler, without being
+ *      merged with other signals of the same number
+ *
+ * - int syssigaltstack(void *stack, int size);
+ *      gives signal handlers a stack of their own to run on
+ *
+ * - int syssigwait(unsigned int mask, int *sig, int *value);
+ *      waits for a signal and returns it, without running a handler
+ *
  * - int syswait(int PID);
  *      allows a process to wait for another process to terminate before
  *      continuing to run
  *
+ * - void sysexit(int status);
+ *      stops the calling process, leaving status for its creator
+ *
+ * - int syswaitany(int *pid, int *status);
+ *      reaps a child that has exited, without blocking
+ *
+ * - int syssetchildsig(int signal);
+ *      sets the signal sent to this process when a child exits
+ *
  * - int sysopen(int device_no);
  *      returns a fd for a device and opens it for that process to use
  *
@@ -39,6 +61,44 @@
  *      allows a process to perform out of band interaction with a device
  *      by with specific commands and their variadic args.
  *
+ * - void *sysmalloc(int size);
+ *      allocates memory from the calling process's own heap arena
+ *
+ * - int sysfree(void *ptr);
+ *      returns memory from sysmalloc to the process's heap arena
+ *
+ * - int sysmeminfo(meminfo *mi);
+ *      reports free and allocated kernel memory, fragmentation and
+ *      allocation failures
+ *
+ * - int sysmemtrace(memsite *sites, int max);
+ *      reports live kernel allocations grouped by call site and owner
+ *
+ * - int syssetmemlimit(int pid, unsigned long limit);
+ *      sets the memory limit of the group a process is charged to
+ *
+ * - unsigned int sysnanosleep(unsigned int ns);
+ *      sleeps for a time not rounded to the 10ms tick
+ *
+ * - unsigned int syssettimerslack(unsigned int ns);
+ *      sets how late the process's sleeps may end, to share wakeups
+ *
+ * - unsigned int syssleepuntil(unsigned long tick);
+ *      sleeps until the tick counter reaches a given value
+ *
+ * - unsigned long sysgetticks(void);
+ *      reads the tick counter, ticks since boot
+ *
+ * - int syssetitimer(int signal, unsigned int initial, unsigned int interval);
+ *      has the kernel send the process a signal after a time, and again
+ *      at every interval after
+ *
+ * - unsigned long long sysgettime(void);
+ *      reads a nanosecond clock that counts from boot
+ *
+ * - int syssettimeout(unsigned int ms);
+ *      limits how long the next system call may block
+ *
  */
 
 #include <xeroskernel.h>
@@ -83,7 +143,20 @@ void sysyield( void ) {
  void sysstop( void ) {
 /**************************/
 
-   syscall( SYS_STOP );
+   syscall( SYS_STOP, 0 );
+}
+
+/*
+ * syscall wrapper to stop the calling process with an exit status. Its
+ * creator gets the status from syswaitany. A process that returns or
+ * calls sysstop exits with 0, and one ended by a signal with minus the
+ * signal number.
+ *
+ * Arguments:
+ *   exit status, 0 or more
+ */
+void sysexit( int status ) {
+  syscall( SYS_STOP, status );
 }
 
 unsigned int sysgetpid( void ) {
@@ -120,7 +193,99 @@ unsigned int syssleep( unsigned int t ) {
 }
 
 /*
- * syscall wrapper to kill a process with a signal
+ * syscall wrapper to sleep for a number of nanoseconds. Unlike syssleep
+ * the sleep is not rounded to a tick, though it can end up to a few
+ * microseconds late. Sleeps are limited to about 4 seconds; use
+ * syssleep for longer ones.
+ *
+ * Arguments:
+ *   ns - nanoseconds to sleep
+ *
+ * Returns
+ *   0 after a full sleep
+ *   the nanoseconds, not milliseconds as syssleep gives, left to sleep
+ *   if woken early by a signal
+ */
+unsigned int sysnanosleep( unsigned int ns ) {
+  return syscall( SYS_NANOSLEEP, ns );
+}
+
+/*
+ * syscall wrapper to set the process's timer slack, how many
+ * nanoseconds its sleeps may end late by. Sleepers whose wakeups fall
+ * within each other's slack are woken together. Processes start with
+ * the slack of their creator.
+ *
+ * Arguments:
+ *   ns - the new slack, 0 for the default of TIMER_SLACK
+ *
+ * Returns
+ *   the previous slack
+ */
+unsigned int syssettimerslack( unsigned int ns ) {
+  return syscall( SYS_TIMERSLACK, ns );
+}
+
+/*
+ * syscall wrapper to sleep until the tick counter reaches tick. A loop
+ * that adds its period to the tick it last woke for runs at that period
+ * however late each wakeup is, where syssleep would add the lateness to
+ * every period.
+ *
+ * Arguments:
+ *   tick - value of sysgetticks to wake at, a passed tick returns at once
+ *
+ * Returns
+ *   0 once the tick is reached
+ *   the milliseconds left if woken early by a signal
+ */
+unsigned int syssleepuntil( unsigned long tick ) {
+  return syscall( SYS_SLEEPUNTIL, tick );
+}
+
+/*
+ * syscall wrapper to read the tick counter. It counts MILLISECONDS_TICK
+ * ticks since boot and never goes backwards.
+ */
+unsigned long sysgetticks( void ) {
+  return syscall( SYS_GETTICKS );
+}
+
+/*
+ * syscall wrapper to read the time, in nanoseconds since boot. It never
+ * goes backwards and is read from the TSC where the CPU has one. A
+ * system call only returns 32 bits, so the kernel writes the time here
+ * instead. The kernel returns -1 without writing it if the address is
+ * bad, which cannot happen for the local used here.
+ */
+unsigned long long sysgettime( void ) {
+  unsigned long long ns;
+
+  syscall( SYS_GETTIME, &ns );
+  return ns;
+}
+
+/*
+ * syscall wrapper to set a timeout on the next system call the process
+ * makes. If that call blocks, on syswait, a sysread or any other wait,
+ * for longer than ms it gives up and returns TIMEOUT. A sysread that
+ * has read some bytes returns those instead. The timeout is used up by
+ * the next call whether it blocks or not.
+ *
+ * Arguments:
+ *   ms - milliseconds the next call may block for, 0 for no timeout
+ *
+ * Returns
+ *   0
+ */
+int syssettimeout( unsigned int ms ) {
+  return syscall( SYS_TIMEOUT, ms );
+}
+
+/*
+ * syscall wrapper to kill a process with a signal. A signal the process
+ * has no handler for is ignored, except that SIGTERM stops it. SIGKILL
+ * stops it and SIGSTOP pauses it until SIGCONT whatever its handlers.
  *
  * Arguments:
  *   pid to deliver the signal to
@@ -135,6 +300,92 @@ int syskill(int pid, int signalNumber) {
   return syscall(SYS_KILL, pid, signalNumber);
 }
 
+/*
+ * syscall wrapper to queue a signal with a value. Signals sent by
+ * syskill are a bit each, so a second one sent before the first is
+ * handled is lost. Each signal sent this way is handled on its own, in
+ * the order they were sent, and the handler is passed value:
+ *
+ *   void handler(void *cntx, int value);
+ *
+ * Arguments:
+ *   pid to deliver the signal to
+ *   signal number to send to
+ *   value for the handler
+ *
+ * Returns:
+ *    0 on success
+ *   -712 if the process does not exist
+ *   -651 if the signal is invalid
+ *   -3 if SIGQUEUE_MAX signals are already waiting
+ */
+int syssigqueue(int pid, int signalNumber, int value) {
+  return syscall(SYS_SIGQUEUE, pid, signalNumber, value);
+}
+
+/*
+ * syscall wrapper to set the stack this process's signal handlers run
+ * on. Without one the handlers, and the frame that calls them, go on
+ * top of whatever the process was using, so its own stack has to have
+ * room for them as well as its normal work.
+ *
+ * Arguments:
+ *   Lowest address of the stack, or NULL for the process's own stack
+ *   Size of the stack in bytes, at least SIGSTACK_MIN
+ *
+ * Returns:
+ *    0 on success
+ *   -1 if the stack is at an invalid address
+ *   -2 if the stack is smaller than SIGSTACK_MIN
+ *   -3 if called from a signal handler
+ */
+int syssigaltstack(void *stack, int size) {
+  return syscall(SYS_SIGSTACK, stack, size);
+}
+
+/*
+ * syscall wrapper to wait for one of a set of signals. The signal is
+ * taken as this call's result instead of being delivered to a handler,
+ * so a process can handle signals in its own loop with one call each.
+ * The signals should be blocked with syssigprocmask first, so any sent
+ * while the process is not waiting are kept for the next call. A
+ * signal in the set needs no handler.
+ *
+ * Arguments:
+ *   Mask with a bit set for each signal to wait for
+ *   Where to put the signal, or NULL
+ *   Where to put the value it was sent with by syssigqueue, 0 if it
+ *   was sent by syskill, or NULL
+ *
+ * Returns:
+ *    0 once a signal has been taken
+ *   -1 if the mask is empty or sig or value is at an invalid address
+ *   -2 if a signal not in the set was delivered to a handler
+ *   TIMEOUT if a timeout set with syssettimeout ran out first
+ */
+int syssigwait(unsigned int mask, int *sig, int *value) {
+  return syscall(SYS_SIGWAIT, mask, sig, value);
+}
+
+/*
+ * syscall wrapper to change the signals this process blocks. A blocked
+ * signal does not interrupt the process; it stays pending until it is
+ * unblocked and is handled then.
+ *
+ * Arguments:
+ *   SIG_BLOCK, SIG_UNBLOCK or SIG_SETMASK
+ *   Mask with bit n set for signal n
+ *   Where to put the old mask, or NULL
+ *
+ * Returns:
+ *    0 on success
+ *   -1 if how is invalid
+ *   -2 if oldmask is at an invalid address
+ */
+int syssigprocmask(int how, unsigned int mask, unsigned int *oldmask) {
+  return syscall(SYS_SIGMASK, how, mask, oldmask);
+}
+
 /*
  * syscall wrapper to get the cpu times
  *
@@ -160,7 +411,7 @@ int sysgetcputimes(processStatuses *ps) {
  *   Pointer to a variable that points to the old handler.
  *
  * Returns
- *   -1 if signal is invalid
+ *   -1 if signal is invalid, or is SIGKILL or SIGSTOP
  *   -2 if the handler resides at an invalid address
  *    0 on success
  */
@@ -168,6 +419,24 @@ int syssighandler(int signal, void (*newHandler)(void *), void (** oldHandler)(v
   return syscall(SYS_SIGHANDLER, signal, newHandler, oldHandler);
 }
 
+/*
+ * syscall wrapper to set the process's interval timer. The timer sends
+ * the process signal after initial milliseconds, then every interval
+ * milliseconds until it is stopped. Setting a timer replaces the last.
+ *
+ * Arguments:
+ *   Signal number to send when the timer goes off
+ *   Milliseconds until it first goes off, 0 stops the timer
+ *   Milliseconds between each time after, 0 to go off once
+ *
+ * Returns
+ *   -1 if signal is invalid
+ *   the milliseconds that were left on the old timer, 0 if none
+ */
+int syssetitimer(int signal, unsigned int initial, unsigned int interval) {
+  return syscall(SYS_SETITIMER, signal, initial, interval);
+}
+
 /*
  * syscall wrapper, only used by the signal trampoline code.
  *
@@ -193,6 +462,42 @@ int syswait(int PID) {
   return syscall(SYS_WAIT, PID);
 }
 
+/*
+ * syscall wrapper to reap a child that has exited. It does not block:
+ * a process managing many children can call it when it gets its child
+ * signal, from a handler or syssigwait, until it returns -1. Children
+ * are reaped in the order they exited.
+ *
+ * Arguments:
+ *   where to put the child's pid, or NULL
+ *   where to put its exit status, or NULL
+ *
+ * Return:
+ *    0 if a child was reaped
+ *    1 if a child was reaped that exited while EXITED_MAX others were
+ *      waiting, so its pid and status were not kept
+ *   -1 if no child has exited since the last one was reaped
+ *   -2 if pid or status is at an invalid address
+ */
+int syswaitany(int *pid, int *status) {
+  return syscall(SYS_WAITANY, pid, status);
+}
+
+/*
+ * syscall wrapper to set the signal sent to this process each time one
+ * of its children exits. It is SIGCHLD until changed.
+ *
+ * Arguments:
+ *   signal to send, or -1 for none
+ *
+ * Return:
+ *   the old signal, -1 if there was none
+ *   -651 if the signal is invalid
+ */
+int syssetchildsig(int signal) {
+  return syscall(SYS_CHILDSIG, signal);
+}
+
 /*
  * syscall wrapper that opens a specified device
  *
@@ -255,7 +560,12 @@ int sysread(int fd, void *buf, int buflen) {
 }
 
 /*
- * syscall wrapper for device specific control command
+ * syscall wrapper for device specific control command. Every device
+ * also takes DEV_NOTIFY with a signal number, to have that signal sent
+ * to this process whenever the device has data to read, so it can
+ * watch several devices without a process blocked reading each. A
+ * read after the signal returns what is there rather than waiting to
+ * fill the buffer. DEV_NOTIFY with -1 stops the signals.
  *
  * Arguments:
  *   controller command
@@ -273,3 +583,86 @@ int sysioctl(int fd, unsigned long command, ...) {
   return result;
 }
 
+
+/*
+ * syscall wrapper to allocate memory from the process heap arena. The
+ * whole arena is released when the process stops or is killed.
+ *
+ * Arguments:
+ *   number of bytes wanted
+ *
+ * Return:
+ *   NULL if size is invalid or memory is exhausted
+ *   pointer to 16 byte aligned memory otherwise
+ */
+void *sysmalloc(int size) {
+  return (void *) syscall(SYS_MALLOC, size);
+}
+
+/*
+ * syscall wrapper to free memory allocated with sysmalloc
+ *
+ * Arguments:
+ *   pointer returned by sysmalloc
+ *
+ * Return:
+ *   0 on success
+ *  -1 if ptr was not allocated by this process
+ */
+int sysfree(void *ptr) {
+  return syscall(SYS_FREE, ptr);
+}
+
+/*
+ * syscall wrapper to get a snapshot of the kernel memory allocator
+ *
+ * Arguments:
+ *   structure to fill with totals, free space on each side of the hole,
+ *   fragmentation, failure counts and allocations by owning process
+ *
+ * Returns
+ *   -1 if the address is in the hole
+ *   -2 if the structure being pointed to goes beyond main mem.
+ *    0 on success
+ */
+int sysmeminfo(meminfo *mi) {
+  return syscall(SYS_MEMINFO, mi);
+}
+
+/*
+ * syscall wrapper to list live kernel allocations by where they were
+ * made, in a kernel built with -DMEM_TRACE
+ *
+ * Arguments:
+ *   sites - table to fill with one entry per call site and owner
+ *   max - number of entries in the table
+ *
+ * Returns
+ *   -1 if the address is in the hole
+ *   -2 if the table goes beyond main mem.
+ *   -3 if allocation tracing is not built in
+ *   the number of entries filled in on success
+ */
+int sysmemtrace(memsite *sites, int max) {
+  return syscall(SYS_MEMTRACE, sites, max);
+}
+
+/*
+ * syscall wrapper to set the memory limit of a process's group. A
+ * process starts in the group of the process that created it, and the
+ * stack pages and heap chunks of every member count against the limit.
+ * Only the process the group was made for can raise the limit. Others
+ * can lower it for themselves or for processes they created.
+ *
+ * Arguments:
+ *   pid - a process in the group
+ *   limit - the new limit in bytes
+ *
+ * Returns
+ *   -1 if there is no process with that pid
+ *   -2 if this process may not change the limit that way
+ *    0 on success
+ */
+int syssetmemlimit(int pid, unsigned long limit) {
+  return syscall(SYS_MEMLIMIT, pid, limit);
+}
@@ -0,0 +1,207 @@
+/* timer.c : kernel timers
+ *
+ * Timers are kept in a hierarchical timing wheel. Level 0 has a slot for
+ * each of the next WHEEL_SIZE ticks; each level above has slots
+ * WHEEL_SIZE times as wide. A timer goes in the slot its expiry falls in
+ * at the lowest level that reaches that far, so adding and cancelling
+ * are O(1). When level 0 wraps, the next slot of level 1 is emptied into
+ * level 0, and so on up, so each timer is moved at most once per level
+ * before it expires.
+ *
+ * A timer with slack may go off late by up to that many ticks. Its expiry
+ * is moved to the tick in that window with the most low bits clear, so
+ * timers with nearby expiries end up on the same tick and are run in one
+ * batch.
+ *
+ * Timer functions are called from tick() by the dispatcher, with
+ * interrupts off.
+ *
+ * - void timer_add( ktimer *t, unsigned long delay, unsigned long slack,
+ *                   timerfn fn, void *arg );
+ *     Call fn(arg) delay ticks from now, or up to slack ticks later
+ *
+ * - void timer_add_at( ktimer *t, unsigned long when, unsigned long slack,
+ *                      timerfn fn, void *arg );
+ *     Call fn(arg) when ticks reaches when, or up to slack ticks later
+ *
+ * - int timer_cancel( ktimer *t );
+ *     Stop a timer before it goes off
+ *
+ * - void timer_tick( void );
+ *     Run the timers that are due, called once per tick
+ */
+
+#include <xeroskernel.h>
+#include <xeroslib.h>
+
+/* Bits of the expiry each level covers, and slots per level */
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      ( 1 << WHEEL_BITS )
+#define WHEEL_MASK      ( WHEEL_SIZE - 1 )
+#define WHEEL_LEVELS    4
+
+/* Furthest ahead the wheel reaches, later timers wait at the top level */
+/* and are placed again when that slot is emptied                      */
+#define WHEEL_SPAN      ( 1UL << ( WHEEL_BITS * WHEEL_LEVELS ) )
+
+
+static ktimer           *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static unsigned long    wheel_time;     /* Next tick the wheel will run */
+
+
+/* Internal Helpers */
+static void             place( ktimer *t );
+static void             cascade( int level );
+static void             unlink_timer( ktimer *t );
+
+
+/*
+ * Starts a timer. The timer must not already be running.
+ *
+ * Arguments:
+ *   t     - the timer, owned by the caller until it goes off or is
+ *           cancelled
+ *   delay - ticks from now, 0 goes off on the next tick
+ *   slack - ticks the timer may go off late by
+ *   fn    - called with arg when the timer goes off
+ */
+void timer_add( ktimer *t, unsigned long delay, unsigned long slack,
+                timerfn fn, void *arg ) {
+
+    timer_add_at( t, ticks + delay, slack, fn, arg );
+}
+
+/*
+ * Starts a timer that goes off at a given tick, so a process waking at
+ * regular ticks does not drift by however late each wakeup was. A tick
+ * that has passed goes off on the next tick.
+ */
+void timer_add_at( ktimer *t, unsigned long when, unsigned long slack,
+                   timerfn fn, void *arg ) {
+
+    unsigned long       early = when, late = early + slack;
+    unsigned long       bit;
+
+    // Clear the low bits of the latest expiry below the highest bit it
+    // differs from the earliest in, staying in the window
+    for( bit = 1UL << 31; bit && !( ( early ^ late ) & bit ); bit >>= 1 );
+    if( bit ) {
+        late &= ~( bit - 1 );
+    }
+
+    t->expires = late;
+    t->fn = fn;
+    t->arg = arg;
+
+    place( t );
+}
+
+/*
+ * Stops a timer.
+ *
+ * Returns:
+ *   the ticks that were left before it would have gone off
+ *   -1 if the timer was not running
+ */
+int timer_cancel( ktimer *t ) {
+
+    if( !t->list ) {
+        return -1;
+    }
+
+    unlink_timer( t );
+
+    return t->expires > ticks ? t->expires - ticks : 0;
+}
+
+/*
+ * Runs the wheel up to the current tick, calling the function of every
+ * timer that has come due.
+ */
+void timer_tick( void ) {
+
+    ktimer              *t;
+    int                 level, slot;
+
+    for( ; wheel_time <= ticks; wheel_time++ ) {
+        slot = wheel_time & WHEEL_MASK;
+
+        // Refill each level from the one above as it wraps
+        for( level = 1; level < WHEEL_LEVELS; level++ ) {
+            if( ( wheel_time >> ( WHEEL_BITS * ( level - 1 ) ) ) & WHEEL_MASK ) {
+                break;
+            }
+            cascade( level );
+        }
+
+        while( ( t = wheel[0][slot] ) ) {
+            unlink_timer( t );
+            t->fn( t->arg );
+        }
+    }
+}
+
+/*
+ * Puts a timer in the slot for its expiry at the lowest level that
+ * reaches it.
+ */
+static void place( ktimer *t ) {
+
+    unsigned long       delta = t->expires - wheel_time;
+    unsigned long       when = t->expires;
+    ktimer              **list;
+    int                 level;
+
+    if( (long)delta < 0 ) {
+        // Already due, run it with the next tick
+        when = wheel_time;
+        delta = 0;
+    } else if( delta >= WHEEL_SPAN ) {
+        when = wheel_time + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+
+    for( level = 0; delta >= 1UL << ( WHEEL_BITS * ( level + 1 ) ); level++ );
+
+    list = &wheel[level][( when >> ( WHEEL_BITS * level ) ) & WHEEL_MASK];
+
+    t->prev = NULL;
+    t->next = *list;
+    if( *list ) {
+        (*list)->prev = t;
+    }
+    *list = t;
+    t->list = list;
+}
+
+/*
+ * Empties the slot of level that wheel_time has just reached into the
+ * levels below it.
+ */
+static void cascade( int level ) {
+
+    ktimer              **list, *t;
+
+    list = &wheel[level][( wheel_time >> ( WHEEL_BITS * level ) ) & WHEEL_MASK];
+
+    while( ( t = *list ) ) {
+        unlink_timer( t );
+        place( t );
+    }
+}
+
+static void unlink_timer( ktimer *t ) {
+
+    if( t->prev ) {
+        t->prev->next = t->next;
+    } else {
+        *t->list = t->next;
+    }
+    if( t->next ) {
+        t->next->prev = t->prev;
+    }
+
+    t->next = NULL;
+    t->prev = NULL;
+    t->list = NULL;
+}
@@ -13,6 +13,15 @@
 
 Bool verbose = FALSE;
 static int test_counter, dest_pid, to_signal;
+static int wake_order[3], wakes;
+static int slept_short, slept_long;
+static int nap_pid, waited;
+static unsigned int child_slack;
+static int values[SIGQUEUE_MAX + 1], nvalues;
+static int spins;
+static int test_creator;
+static char altstack[4096];
+static unsigned long handler_sp;
 
 
 /*
@@ -62,6 +71,21 @@ void triple_handler( void *cntx ) {
   test_counter = 3 * test_counter;
 }
 
+/*
+ * Signal handler to record the values sent with syssigqueue
+ */
+void record_handler( void *cntx, int value ) {
+  values[nvalues++] = value;
+}
+
+/*
+ * Signal handler to record where its stack is
+ */
+void where_handler( void *cntx ) {
+  char here;
+  handler_sp = (unsigned long) &here;
+}
+
 /*
  * Signal handler to syskill dest_pid with to_signal
  */
@@ -248,6 +272,410 @@ void test_signal_priority( void ) {
 
 
 
+/*
+ * Test syssigprocmask
+ */
+void test_syssigprocmask( void ) {
+  int test_result = 1;
+  char *str[500];
+
+  int ret, pid;
+  unsigned int old;
+  void (*oldhandler)(void *);
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  pid = sysgetpid();
+  syssighandler(31, increment_handler, &oldhandler);
+  test_counter = 0;
+
+  //Test Case 1: invalid how
+  ret = syssigprocmask(7, 0, NULL);
+  test_result &= assert_equal(-1, ret, __func__, 1, "how should be invalid");
+
+  //Test Case 2: invalid address for the old mask
+  ret = syssigprocmask(SIG_BLOCK, 0, (unsigned int *) -100);
+  test_result &= assert_equal(-2, ret, __func__, 2, "address should be invalid");
+
+  //Test Case 3: a blocked signal waits until it is unblocked
+  syssigprocmask(SIG_BLOCK, 1 << 31, NULL);
+  syskill(pid, 31);
+  test_result &= assert_equal(0, test_counter, __func__, 3, "blocked signal delivered");
+  ret = syssigprocmask(SIG_UNBLOCK, 1 << 31, &old);
+  test_result &= assert_equal(0, ret, __func__, 3, "unblock failed");
+  test_result &= assert_equal(1 << 31, old, __func__, 3, "wrong old mask");
+  test_result &= assert_equal(1, test_counter, __func__, 3, "pending signal not delivered");
+
+  //Test Case 4: a blocked signal does not end a sleep
+  syssigprocmask(SIG_SETMASK, 1 << 31, NULL);
+  syssetitimer(31, 30, 0);
+  ret = syssleep(100);
+  test_result &= assert_equal(0, ret, __func__, 4, "sleep cut short");
+  test_result &= assert_equal(1, test_counter, __func__, 4, "blocked signal delivered");
+  syssigprocmask(SIG_SETMASK, 0, &old);
+  test_result &= assert_equal(1 << 31, old, __func__, 4, "wrong old mask");
+  test_result &= assert_equal(2, test_counter, __func__, 4, "pending signal not delivered");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Test syssigqueue
+ */
+void test_syssigqueue( void ) {
+  int test_result = 1;
+  char *str[500];
+
+  int ret, pid, j;
+  void (*oldhandler)(void *);
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  pid = sysgetpid();
+  syssighandler(20, (void (*)(void *)) record_handler, &oldhandler);
+
+  //Test Case 1: process does not exist, signal is invalid
+  ret = syssigqueue(12345, 20, 1);
+  test_result &= assert_equal(-712, ret, __func__, 1, "process should not exist");
+  ret = syssigqueue(pid, 34, 1);
+  test_result &= assert_equal(-651, ret, __func__, 1, "signal should be invalid");
+
+  //Test Case 2: every value is delivered, in the order sent
+  nvalues = 0;
+  syssigprocmask(SIG_BLOCK, 1 << 20, NULL);
+  syssigqueue(pid, 20, 7);
+  syssigqueue(pid, 20, 8);
+  syssigqueue(pid, 20, 9);
+  syssigprocmask(SIG_UNBLOCK, 1 << 20, NULL);
+  sysyield();
+  test_result &= assert_equal(3, nvalues, __func__, 2, "signals lost");
+  test_result &= assert_equal(7, values[0], __func__, 2, "wrong first value");
+  test_result &= assert_equal(8, values[1], __func__, 2, "wrong second value");
+  test_result &= assert_equal(9, values[2], __func__, 2, "wrong third value");
+
+  //Test Case 3: syskill still merges, and passes 0
+  nvalues = 0;
+  syssigprocmask(SIG_BLOCK, 1 << 20, NULL);
+  syskill(pid, 20);
+  syskill(pid, 20);
+  syssigprocmask(SIG_UNBLOCK, 1 << 20, NULL);
+  sysyield();
+  test_result &= assert_equal(1, nvalues, __func__, 3, "syskill signals not merged");
+  test_result &= assert_equal(0, values[0], __func__, 3, "syskill passed a value");
+
+  //Test Case 4: the queue is full at SIGQUEUE_MAX
+  nvalues = 0;
+  syssigprocmask(SIG_BLOCK, 1 << 20, NULL);
+  for( j = 0; j < SIGQUEUE_MAX; j++ ) {
+    syssigqueue(pid, 20, j);
+  }
+  ret = syssigqueue(pid, 20, j);
+  test_result &= assert_equal(-3, ret, __func__, 4, "queue should be full");
+  syssigprocmask(SIG_UNBLOCK, 1 << 20, NULL);
+  sysyield();
+  test_result &= assert_equal(SIGQUEUE_MAX, nvalues, __func__, 4, "signals lost");
+  test_result &= assert_equal(SIGQUEUE_MAX - 1, values[SIGQUEUE_MAX - 1], __func__, 4, "wrong last value");
+
+  //Test Case 5: a burst of signals is handled, highest first, before
+  //the call that unblocked them returns
+  nvalues = 0;
+  syssighandler(21, (void (*)(void *)) record_handler, &oldhandler);
+  syssighandler(22, (void (*)(void *)) record_handler, &oldhandler);
+  syssigprocmask(SIG_BLOCK, 7 << 20, NULL);
+  syssigqueue(pid, 20, 20);
+  syssigqueue(pid, 22, 22);
+  syssigqueue(pid, 21, 21);
+  syssigqueue(pid, 22, 23);
+  syssigprocmask(SIG_UNBLOCK, 7 << 20, NULL);
+  test_result &= assert_equal(4, nvalues, __func__, 5, "signals not all handled");
+  test_result &= assert_equal(22, values[0], __func__, 5, "wrong first signal");
+  test_result &= assert_equal(23, values[1], __func__, 5, "wrong second signal");
+  test_result &= assert_equal(21, values[2], __func__, 5, "wrong third signal");
+  test_result &= assert_equal(20, values[3], __func__, 5, "wrong fourth signal");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Counts in spins until killed
+ */
+void count_forever( void ) {
+  for( ; ; ) {
+    spins++;
+    sysyield();
+  }
+}
+
+
+/*
+ * Test what signals do with no handler, and SIGKILL, SIGSTOP and SIGCONT
+ */
+void test_default_actions( void ) {
+  int test_result = 1;
+  char *str[500];
+  static processStatuses ps;
+
+  int ret, pid, procs, j, before;
+  void (*oldhandler)(void *);
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: SIGKILL and SIGSTOP cannot be handled
+  ret = syssighandler(SIGKILL, increment_handler, &oldhandler);
+  test_result &= assert_equal(-1, ret, __func__, 1, "SIGKILL handler installed");
+  ret = syssighandler(SIGSTOP, increment_handler, &oldhandler);
+  test_result &= assert_equal(-1, ret, __func__, 1, "SIGSTOP handler installed");
+
+  //Test Case 2: SIGTERM with no handler stops the process
+  pid = syscreate(count_forever, 1024);
+  sysyield();
+  syskill(pid, SIGTERM);
+  ret = syswait(pid);
+  test_result &= assert_equal(-1, ret, __func__, 2, "process not terminated");
+
+  //Test Case 3: SIGSTOP pauses a process and SIGCONT lets it go on
+  pid = syscreate(count_forever, 1024);
+  sysyield();
+  syskill(pid, SIGSTOP);
+  before = spins;
+  syssleep(50);
+  test_result &= assert_equal(before, spins, __func__, 3, "paused process ran");
+  procs = sysgetcputimes(&ps);
+  for( j = 0; j <= procs && ps.pid[j] != pid; j++ );
+  test_result &= assert_equal(STATE_PAUSED, ps.status[j], __func__, 3, "process not paused");
+  syskill(pid, SIGCONT);
+  syssleep(50);
+  test_result &= assert_equal(1, spins > before, __func__, 3, "process not continued");
+
+  //Test Case 4: SIGKILL stops a paused process
+  syskill(pid, SIGSTOP);
+  syskill(pid, SIGKILL);
+  ret = syswait(pid);
+  test_result &= assert_equal(-1, ret, __func__, 4, "paused process not killed");
+
+  //Test Case 5: SIGKILL stops a sleeping process
+  slept_long = 0;
+  pid = syscreate(nap_long, 1024);
+  sysyield();
+  syskill(pid, SIGKILL);
+  syssleep(300);
+  test_result &= assert_equal(0, slept_long, __func__, 5, "killed process woke");
+  ret = syswait(pid);
+  test_result &= assert_equal(-1, ret, __func__, 5, "sleeping process not killed");
+
+  //Test Case 6: other signals with no handler are still ignored
+  pid = syscreate(count_forever, 1024);
+  sysyield();
+  syskill(pid, 1);
+  before = spins;
+  syssleep(50);
+  test_result &= assert_equal(1, spins > before, __func__, 6, "process stopped by signal 1");
+  syskillproc(pid);
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Test syssigaltstack
+ */
+void test_syssigaltstack( void ) {
+  int test_result = 1;
+  char *str[500];
+
+  int ret, pid;
+  void (*oldhandler)(void *);
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  pid = sysgetpid();
+  syssighandler(5, where_handler, &oldhandler);
+
+  //Test Case 1: invalid stack address
+  ret = syssigaltstack((void *) -100, 4096);
+  test_result &= assert_equal(-1, ret, __func__, 1, "address should be invalid");
+
+  //Test Case 2: stack too small
+  ret = syssigaltstack(altstack, SIGSTACK_MIN - 1);
+  test_result &= assert_equal(-2, ret, __func__, 2, "stack should be too small");
+
+  //Test Case 3: handlers run on the alternate stack
+  ret = syssigaltstack(altstack, sizeof(altstack));
+  test_result &= assert_equal(0, ret, __func__, 3, "syssigaltstack failed");
+  syskill(pid, 5);
+  test_result &= assert_equal(1, handler_sp >= (unsigned long) altstack && handler_sp < (unsigned long) (altstack + sizeof(altstack)),
+                              __func__, 3, "handler not on the alternate stack");
+
+  //Test Case 4: the return code of an interrupted call is kept
+  syssetitimer(5, 30, 0);
+  ret = syssleep(200);
+  test_result &= assert_equal(1, ret > 0 && ret <= 200, __func__, 4, "wrong sleep return code");
+
+  //Test Case 5: a stack in the next process's stack slot
+  ret = syssigaltstack((char *) &ret + STACK_VSIZE, 4096);
+  test_result &= assert_equal(-1, ret, __func__, 5, "another process's stack accepted");
+
+  //Test Case 6: with no alternate stack handlers use the process's stack
+  syssigaltstack(NULL, 0);
+  syskill(pid, 5);
+  test_result &= assert_equal(0, handler_sp >= (unsigned long) altstack && handler_sp < (unsigned long) (altstack + sizeof(altstack)),
+                              __func__, 6, "handler still on the alternate stack");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Test syssigwait
+ */
+void test_syssigwait( void ) {
+  int test_result = 1;
+  char *str[500];
+
+  int ret, pid, sig, value;
+  void (*oldhandler)(void *);
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  pid = sysgetpid();
+  syssigprocmask(SIG_BLOCK, 3 << 23, NULL);
+
+  //Test Case 1: empty mask, invalid address
+  ret = syssigwait(0, &sig, &value);
+  test_result &= assert_equal(-1, ret, __func__, 1, "mask should be invalid");
+  ret = syssigwait(1 << 23, (int *) -100, &value);
+  test_result &= assert_equal(-1, ret, __func__, 1, "address should be invalid");
+
+  //Test Case 2: a pending signal with no handler is taken at once
+  syssigqueue(pid, 23, 42);
+  sig = value = -1;
+  ret = syssigwait(1 << 23, &sig, &value);
+  test_result &= assert_equal(0, ret, __func__, 2, "syssigwait failed");
+  test_result &= assert_equal(23, sig, __func__, 2, "wrong signal");
+  test_result &= assert_equal(42, value, __func__, 2, "wrong value");
+
+  //Test Case 3: waits until a signal in the set is sent
+  syssetitimer(24, 30, 0);
+  sig = value = -1;
+  ret = syssigwait(3 << 23, &sig, &value);
+  test_result &= assert_equal(0, ret, __func__, 3, "syssigwait failed");
+  test_result &= assert_equal(24, sig, __func__, 3, "wrong signal");
+  test_result &= assert_equal(0, value, __func__, 3, "wrong value");
+
+  //Test Case 4: a timeout ends the wait
+  syssettimeout(30);
+  ret = syssigwait(1 << 23, &sig, &value);
+  test_result &= assert_equal(TIMEOUT, ret, __func__, 4, "wait did not time out");
+
+  //Test Case 5: a handled signal not in the set ends the wait
+  test_counter = 0;
+  syssighandler(25, increment_handler, &oldhandler);
+  syssetitimer(25, 30, 0);
+  ret = syssigwait(1 << 23, &sig, &value);
+  test_result &= assert_equal(-2, ret, __func__, 5, "wrong return code on signaled");
+  test_result &= assert_equal(1, test_counter, __func__, 5, "handler not run");
+
+  syssigprocmask(SIG_UNBLOCK, 3 << 23, NULL);
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Exits with status 7
+ */
+static void exit_seven( void ) {
+  sysexit(7);
+}
+
+
+/*
+ * Test syswaitany, sysexit and the child signal
+ */
+void test_syswaitany( void ) {
+  int test_result = 1;
+  char *str[500];
+
+  int ret, pid, child, status, sig, j;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  syssigprocmask(SIG_BLOCK, (1 << SIGCHLD) | (1 << 27), NULL);
+
+  //Test Case 1: no child has exited, invalid address
+  ret = syswaitany(&pid, &status);
+  test_result &= assert_equal(-1, ret, __func__, 1, "no child should have exited");
+  ret = syswaitany((int *) -100, &status);
+  test_result &= assert_equal(-2, ret, __func__, 1, "address should be invalid");
+
+  //Test Case 2: SIGCHLD is sent, and the status from sysexit kept
+  child = syscreate(exit_seven, 1024);
+  sig = -1;
+  syssigwait(1 << SIGCHLD, &sig, NULL);
+  test_result &= assert_equal(SIGCHLD, sig, __func__, 2, "SIGCHLD not sent");
+  ret = syswaitany(&pid, &status);
+  test_result &= assert_equal(0, ret, __func__, 2, "child not reaped");
+  test_result &= assert_equal(child, pid, __func__, 2, "wrong pid");
+  test_result &= assert_equal(7, status, __func__, 2, "wrong status");
+  ret = syswaitany(&pid, &status);
+  test_result &= assert_equal(-1, ret, __func__, 2, "child reaped twice");
+
+  //Test Case 3: a killed child exits with minus the signal
+  child = syscreate(count_forever, 1024);
+  sysyield();
+  syskill(child, SIGTERM);
+  syssigwait(1 << SIGCHLD, NULL, NULL);
+  ret = syswaitany(&pid, &status);
+  test_result &= assert_equal(child, pid, __func__, 3, "wrong pid");
+  test_result &= assert_equal(-SIGTERM, status, __func__, 3, "wrong status");
+
+  //Test Case 4: the child signal can be changed
+  ret = syssetchildsig(MAX_SIGNALS);
+  test_result &= assert_equal(-651, ret, __func__, 4, "signal should be invalid");
+  ret = syssetchildsig(27);
+  test_result &= assert_equal(SIGCHLD, ret, __func__, 4, "wrong old signal");
+  child = syscreate(exit_seven, 1024);
+  sig = -1;
+  syssigwait((1 << SIGCHLD) | (1 << 27), &sig, NULL);
+  test_result &= assert_equal(27, sig, __func__, 4, "wrong signal sent");
+  ret = syswaitany(&pid, &status);
+  test_result &= assert_equal(child, pid, __func__, 4, "wrong pid");
+  syssetchildsig(SIGCHLD);
+
+  //Test Case 5: children past EXITED_MAX are still counted
+  for( j = 0; j <= EXITED_MAX; j++ ) {
+    child = syscreate(exit_seven, 1024);
+    syswait(child);
+  }
+  for( j = 0; j < EXITED_MAX; j++ ) {
+    ret = syswaitany(&pid, &status);
+    test_result &= assert_equal(0, ret, __func__, 5, "child not reaped");
+  }
+  ret = syswaitany(&pid, &status);
+  test_result &= assert_equal(1, ret, __func__, 5, "lost child not counted");
+  ret = syswaitany(&pid, &status);
+  test_result &= assert_equal(-1, ret, __func__, 5, "child reaped twice");
+
+  syssigprocmask(SIG_UNBLOCK, (1 << SIGCHLD) | (1 << 27), NULL);
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
 /*
  * Test syswait
  */
@@ -307,6 +735,24 @@ void run_signal_tests( void ) {
 
   pid = syscreate(test_syswait, 1024);
   syswait(pid);
+
+  pid = syscreate(test_syssigprocmask, 4096);
+  syswait(pid);
+
+  pid = syscreate(test_syssigqueue, 4096);
+  syswait(pid);
+
+  pid = syscreate(test_default_actions, 4096);
+  syswait(pid);
+
+  pid = syscreate(test_syssigaltstack, 4096);
+  syswait(pid);
+
+  pid = syscreate(test_syssigwait, 4096);
+  syswait(pid);
+
+  pid = syscreate(test_syswaitany, 4096);
+  syswait(pid);
 }
 
 
@@ -431,6 +877,16 @@ void test_sysioctl( void ) {
   ret = sysioctl(fd, command, 87);
   test_result &= assert_equal(0, ret, __func__, 4, "command should be valid");
 
+  //Test Case 5: DEV_NOTIFY with an invalid signal
+  ret = sysioctl(fd, DEV_NOTIFY, MAX_SIGNALS);
+  test_result &= assert_equal(-1, ret, __func__, 5, "signal should be invalid");
+
+  //Test Case 6: arm and disarm DEV_NOTIFY
+  ret = sysioctl(fd, DEV_NOTIFY, 30);
+  test_result &= assert_equal(0, ret, __func__, 6, "notify not armed");
+  ret = sysioctl(fd, DEV_NOTIFY, -1);
+  test_result &= assert_equal(0, ret, __func__, 6, "notify not disarmed");
+
 
   sysclose(fd);
   sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
@@ -528,6 +984,806 @@ void run_device_tests( void ) {
 }
 
 
+/*
+ * Test stack high-water marks reported through sysgetcputimes
+ */
+void test_stack_usage( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  processStatuses psTab;
+  int procs, j, pid, used = -1, size = -1;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  pid = sysgetpid();
+  procs = sysgetcputimes(&psTab);
+  for( j = 0; j <= procs; j++ ) {
+    if ( psTab.pid[j] == pid ) {
+      used = psTab.stackUsed[j];
+      size = psTab.stackSize[j];
+    }
+  }
+
+  //Test Case 1: small request bumped to PROC_STACK without a profile
+  test_result &= assert_equal(PROC_STACK, size, __func__, 1, "stack size not bumped");
+
+  //Test Case 2: some of the stack has been used
+  test_result &= assert_equal(1, used > 0, __func__, 2, "no stack use recorded");
+
+  //Test Case 3: high-water mark is within the stack
+  test_result &= assert_equal(1, used <= size, __func__, 3, "stack use larger than stack");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Recurses until it runs into the guard page below its stack
+ */
+void overflow_helper( void ) {
+  volatile char pad[512];
+
+  pad[0] = 1;
+  if ( pad[0] ) overflow_helper();
+}
+
+
+/*
+ * Test stacks that are paged in on demand and guarded against overflow
+ */
+void test_stack_guard( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  processStatuses psTab;
+  int procs, j, pid, ret, used = -1, size = -1;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  pid = sysgetpid();
+  procs = sysgetcputimes(&psTab);
+  for( j = 0; j <= procs; j++ ) {
+    if ( psTab.pid[j] == pid ) {
+      used = psTab.stackUsed[j];
+      size = psTab.stackSize[j];
+    }
+  }
+
+  //Test Case 1: large stack reserved, only the touched part paged in
+  test_result &= assert_equal(STACK_VSIZE / 2, size, __func__, 1, "large stack not reserved");
+  test_result &= assert_equal(1, used > 0 && used < PROC_STACK, __func__, 1, "untouched stack paged in");
+
+  //Test Case 2: stack and guard page must fit in a slot
+  ret = syscreate(overflow_helper, STACK_VSIZE);
+  test_result &= assert_equal(CREATE_FAILURE, ret, __func__, 2, "oversized stack allowed");
+
+  //Test Case 3: overflowing process is stopped, we carry on
+  pid = syscreate(overflow_helper, PROC_STACK);
+  ret = syswait(pid);
+  test_result &= assert_equal(0, ret, __func__, 3, "overflowing process not stopped");
+
+  procs = sysgetcputimes(&psTab);
+  for( j = 0; j <= procs; j++ ) {
+    test_result &= assert_equal(1, psTab.pid[j] != pid, __func__, 3, "overflowing process still running");
+  }
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Test sysmalloc and sysfree
+ */
+void test_sysmalloc( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  char *a, *b, *c, *big;
+  int ret;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: invalid size
+  a = sysmalloc(0);
+  test_result &= assert_equal(0, (int) a, __func__, 1, "size should be invalid");
+
+  //Test Case 2: distinct 16 byte aligned allocations
+  a = sysmalloc(10);
+  b = sysmalloc(10);
+  test_result &= assert_equal(1, a && b && a != b, __func__, 2, "allocation failed");
+  test_result &= assert_equal(0, ((int) a | (int) b) & 0xf, __func__, 2, "not 16 byte aligned");
+
+  //Test Case 3: freed object reused by same size class
+  ret = sysfree(a);
+  test_result &= assert_equal(0, ret, __func__, 3, "sysfree failed");
+  c = sysmalloc(12);
+  test_result &= assert_equal((int) a, (int) c, __func__, 3, "freed object not reused");
+
+  //Test Case 4: double free and foreign pointers rejected
+  ret = sysfree(b);
+  ret = sysfree(b);
+  test_result &= assert_equal(-1, ret, __func__, 4, "double free not caught");
+  ret = sysfree(&ret);
+  test_result &= assert_equal(-1, ret, __func__, 4, "foreign pointer not caught");
+
+  //Test Case 5: large allocation, usable and freeable
+  big = sysmalloc(20000);
+  test_result &= assert_equal(1, big != NULL, __func__, 5, "large allocation failed");
+  big[0] = 'a';
+  big[19999] = 'z';
+  ret = sysfree(big);
+  test_result &= assert_equal(0, ret, __func__, 5, "large free failed");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Test sysmeminfo
+ */
+void test_sysmeminfo( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  meminfo before, after;
+  int ret, j, pid, bytes = 0;
+  char *a;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: structure in the hole
+  ret = sysmeminfo((meminfo *) (641 * 1024));
+  test_result &= assert_equal(-1, ret, __func__, 1, "address in hole not caught");
+
+  //Test Case 2: totals are consistent
+  ret = sysmeminfo(&before);
+  test_result &= assert_equal(0, ret, __func__, 2, "sysmeminfo failed");
+  test_result &= assert_equal(1, before.lowFree <= before.lowTotal
+                              && before.highFree <= before.highTotal, __func__, 2, "free larger than total");
+  test_result &= assert_equal(1, before.largestFree <= before.lowFree + before.highFree,
+                              __func__, 2, "largest block larger than free memory");
+
+  //Test Case 3: arena chunk charged to this process
+  pid = sysgetpid();
+  a = sysmalloc(100);
+  sysmeminfo(&after);
+  for( j = 0; j < after.owners; j++ ) {
+    if ( after.pid[j] == pid ) bytes = after.bytes[j];
+  }
+  test_result &= assert_equal(1, a && bytes > 100, __func__, 3, "arena not charged to process");
+  test_result &= assert_equal(1, after.lowFree + after.highFree < before.lowFree + before.highFree,
+                              __func__, 3, "free memory did not drop");
+
+  //Test Case 4: structure under this process's stack, in its guard
+  ret = sysmeminfo((meminfo *) ((char *) &ret - STACK_VSIZE / 2));
+  test_result &= assert_equal(-2, ret, __func__, 4, "address under the stack not caught");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Test sysmemtrace
+ */
+void test_sysmemtrace( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  memsite sites[32];
+  int ret, j, pid, bytes = 0;
+  char *a;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: table in the hole
+  ret = sysmemtrace((memsite *) (641 * 1024), 4);
+  test_result &= assert_equal(-1, ret, __func__, 1, "address in hole not caught");
+
+  ret = sysmemtrace(sites, 32);
+  if ( ret == -3 ) {
+    sysputs("Kernel built without MEM_TRACE, skipping the rest\n");
+  } else {
+    //Test Case 2: no more sites than room in the table
+    test_result &= assert_equal(1, ret >= 0 && ret <= 32, __func__, 2, "bad number of sites");
+
+    //Test Case 3: arena chunk traced to this process
+    pid = sysgetpid();
+    a = sysmalloc(100);
+    ret = sysmemtrace(sites, 32);
+    for( j = 0; j < ret; j++ ) {
+      if ( sites[j].pid == pid ) bytes += sites[j].bytes;
+    }
+    test_result &= assert_equal(1, a && bytes > 100, __func__, 3, "arena chunk not traced");
+  }
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Test syssetmemlimit
+ */
+void test_syssetmemlimit( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  processStatuses ps;
+  int ret, j, procs, pid, slot = 0;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: no such process
+  ret = syssetmemlimit(-1, MEM_QUOTA);
+  test_result &= assert_equal(-1, ret, __func__, 1, "bad pid not caught");
+
+  //Test Case 2: this process is charged for its stack
+  pid = sysgetpid();
+  procs = sysgetcputimes(&ps);
+  for( j = 0; j <= procs; j++ ) {
+    if ( ps.pid[j] == pid ) slot = j;
+  }
+  test_result &= assert_equal(1, ps.memUsed[slot] >= 4096
+                              && ps.groupUsed[slot] >= ps.memUsed[slot],
+                              __func__, 2, "stack not charged");
+
+  //Test Case 3: allocations and children over the limit fail
+  ret = syssetmemlimit(pid, ps.groupUsed[slot] + 100);
+  test_result &= assert_equal(0, ret, __func__, 3, "syssetmemlimit failed");
+  test_result &= assert_equal(1, sysmalloc(20000) == NULL, __func__, 3, "allocation over limit");
+  ret = syscreate(sysstop, 1024);
+  test_result &= assert_equal(CREATE_FAILURE, ret, __func__, 3, "process created over limit");
+
+  //Test Case 4: only the process the group was made for can raise it,
+  //and no process can lower the limit of one it did not create
+  ret = syssetmemlimit(pid, MEM_QUOTA);
+  test_result &= assert_equal(-2, ret, __func__, 4, "limit raised from inside the group");
+  ret = syssetmemlimit(test_creator, 0);
+  test_result &= assert_equal(-2, ret, __func__, 4, "creator's limit lowered");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Run all memory tests
+ */
+void run_memory_tests( void ) {
+  int pid;
+
+  pid = syscreate(test_stack_usage, 1024);
+  syswait(pid);
+
+  pid = syscreate(test_stack_guard, STACK_VSIZE / 2);
+  syswait(pid);
+
+  pid = syscreate(test_sysmalloc, 1024);
+  syswait(pid);
+
+  pid = syscreate(test_sysmeminfo, 1024);
+  syswait(pid);
+
+  pid = syscreate(test_sysmemtrace, 1024);
+  syswait(pid);
+
+  test_creator = sysgetpid();
+  pid = syscreate(test_syssetmemlimit, 8192);
+  syswait(pid);
+  syssetmemlimit(test_creator, MEM_QUOTA);
+}
+
+
+/*
+ * Sleepers for test_syssleep, recording the order they wake in
+ */
+void sleep_short( void ) {
+  syssleep(30);
+  wake_order[wakes++] = 30;
+}
+
+void sleep_mid( void ) {
+  syssleep(700);
+  wake_order[wakes++] = 700;
+}
+
+void sleep_long( void ) {
+  syssleep(1500);
+  wake_order[wakes++] = 1500;
+}
+
+void sleep_same( void ) {
+  if ( syssleep(100) == 0 ) wakes++;
+}
+
+
+/*
+ * Test syssleep
+ */
+void test_syssleep( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  int pids[20];
+  int j, ret;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: a full sleep returns 0
+  ret = syssleep(50);
+  test_result &= assert_equal(0, ret, __func__, 1, "syssleep not 0 after full sleep");
+
+  //Test Case 2: sleepers wake in order of their deadlines, not of going
+  //to sleep, including ones far enough off to start above level 0
+  wakes = 0;
+  pids[0] = syscreate(sleep_long, 1024);
+  pids[1] = syscreate(sleep_mid, 1024);
+  pids[2] = syscreate(sleep_short, 1024);
+  for( j = 0; j < 3; j++ ) {
+    syswait(pids[j]);
+  }
+  test_result &= assert_equal(3, wakes, __func__, 2, "not every sleeper woke");
+  test_result &= assert_equal(30, wake_order[0], __func__, 2, "wrong first sleeper");
+  test_result &= assert_equal(700, wake_order[1], __func__, 2, "wrong second sleeper");
+  test_result &= assert_equal(1500, wake_order[2], __func__, 2, "wrong third sleeper");
+
+  //Test Case 3: sleepers sharing a deadline all wake
+  wakes = 0;
+  for( j = 0; j < 20; j++ ) {
+    pids[j] = syscreate(sleep_same, 1024);
+  }
+  for( j = 0; j < 20; j++ ) {
+    syswait(pids[j]);
+  }
+  test_result &= assert_equal(20, wakes, __func__, 3, "not every sleeper woke");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Sleepers for test_sysnanosleep, setting a flag when they wake
+ */
+void nap_short( void ) {
+  syssleep(30);
+  slept_short = 1;
+}
+
+void nap_long( void ) {
+  syssleep(200);
+  slept_long = 1;
+}
+
+
+/*
+ * Test sysnanosleep
+ */
+void test_sysnanosleep( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  void (*oldhandler)(void *);
+  int pids[2];
+  int j, ret;
+  unsigned int left;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: no sleep and a full sleep return 0
+  ret = sysnanosleep(0);
+  test_result &= assert_equal(0, ret, __func__, 1, "sysnanosleep(0) not 0");
+  ret = sysnanosleep(500000);
+  test_result &= assert_equal(0, ret, __func__, 1, "sysnanosleep not 0 after full sleep");
+
+  //Test Case 2: fifty 1ms sleeps take about 50ms, not nothing and not
+  //fifty ticks; checked against sleepers of 30ms and 200ms
+  slept_short = slept_long = 0;
+  pids[0] = syscreate(nap_short, 1024);
+  pids[1] = syscreate(nap_long, 1024);
+  for( j = 0; j < 50; j++ ) {
+    sysnanosleep(1000000);
+  }
+  test_result &= assert_equal(1, slept_short, __func__, 2, "1ms sleeps too short");
+  test_result &= assert_equal(0, slept_long, __func__, 2, "1ms sleeps rounded up");
+  syswait(pids[0]);
+  syswait(pids[1]);
+
+  //Test Case 3: the time left of a sleep too long for an int comes back
+  //whole when a signal cuts it short
+  syssighandler(31, increment_handler, &oldhandler);
+  test_counter = 0;
+  syssetitimer(31, 30, 0);
+  left = sysnanosleep(3000000000U);
+  test_result &= assert_equal(1, test_counter, __func__, 3, "sleep not cut short");
+  test_result &= assert_equal(1, left > 2900000000U && left < 3000000000U,
+                              __func__, 3, "wrong time left");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Records the timer slack a process starts with
+ */
+void slack_child( void ) {
+  child_slack = syssettimerslack(0);
+}
+
+
+/*
+ * Test syssettimerslack
+ */
+void test_syssettimerslack( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  int pid;
+  unsigned int ret;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: processes start with the default, and setting it
+  //returns the old slack
+  ret = syssettimerslack(5000000);
+  test_result &= assert_equal(TIMER_SLACK, ret, __func__, 1, "not the default slack");
+  ret = syssettimerslack(5000000);
+  test_result &= assert_equal(5000000, ret, __func__, 1, "slack not set");
+
+  //Test Case 2: children inherit the slack
+  pid = syscreate(slack_child, 1024);
+  syswait(pid);
+  test_result &= assert_equal(5000000, child_slack, __func__, 2, "slack not inherited");
+
+  //Test Case 3: sleeps with slack still last at least as long as asked
+  slept_short = 0;
+  pid = syscreate(nap_short, 1024);
+  ret = sysnanosleep(40000000);
+  test_result &= assert_equal(0, ret, __func__, 3, "sysnanosleep not 0 after full sleep");
+  test_result &= assert_equal(1, slept_short, __func__, 3, "sleep with slack too short");
+  syswait(pid);
+
+  //Test Case 4: 0 puts the default back
+  syssettimerslack(0);
+  ret = syssettimerslack(0);
+  test_result &= assert_equal(TIMER_SLACK, ret, __func__, 4, "default slack not restored");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Test syssleepuntil and sysgetticks
+ */
+void test_syssleepuntil( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  unsigned long start, when, now;
+  int j;
+  unsigned int ret;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  syssettimerslack(1);
+
+  //Test Case 1: the tick counter moves forward
+  start = sysgetticks();
+  syssleep(50);
+  now = sysgetticks();
+  test_result &= assert_equal(1, now >= start + 5, __func__, 1, "ticks did not advance");
+
+  //Test Case 2: a passed tick returns at once
+  ret = syssleepuntil(start);
+  test_result &= assert_equal(0, ret, __func__, 2, "passed tick did not return 0");
+
+  //Test Case 3: wakes on the tick asked for
+  when = sysgetticks() + 3;
+  ret = syssleepuntil(when);
+  now = sysgetticks();
+  test_result &= assert_equal(0, ret, __func__, 3, "syssleepuntil not 0");
+  test_result &= assert_equal(when, now, __func__, 3, "woke on the wrong tick");
+
+  //Test Case 4: a periodic loop doing work each period does not drift
+  start = when = sysgetticks();
+  for( j = 0; j < 10; j++ ) {
+    sysputs("");
+    when += 2;
+    syssleepuntil(when);
+  }
+  now = sysgetticks();
+  test_result &= assert_equal(start + 20, now, __func__, 4, "periodic loop drifted");
+
+  syssettimerslack(0);
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Test syssetitimer
+ */
+void test_syssetitimer( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  void (*oldhandler)(void *);
+  int ret, j;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  syssighandler(31, increment_handler, &oldhandler);
+  test_counter = 0;
+
+  //Test Case 1: invalid signal
+  ret = syssetitimer(35, 100, 0);
+  test_result &= assert_equal(-1, ret, __func__, 1, "invalid signal allowed");
+
+  //Test Case 2: a one shot timer goes off once and ends a sleep early
+  ret = syssetitimer(31, 30, 0);
+  test_result &= assert_equal(0, ret, __func__, 2, "no old timer but time left");
+  ret = syssleep(200);
+  test_result &= assert_equal(1, ret > 0, __func__, 2, "sleep not cut short");
+  test_result &= assert_equal(1, test_counter, __func__, 2, "handler not called once");
+  syssleep(100);
+  test_result &= assert_equal(1, test_counter, __func__, 2, "one shot went off again");
+
+  //Test Case 3: a periodic timer keeps going off
+  test_counter = 0;
+  syssetitimer(31, 20, 20);
+  for( j = 0; j < 50 && test_counter < 3; j++ ) {
+    syssleep(100);
+  }
+  test_result &= assert_equal(3, test_counter, __func__, 3, "periodic timer stopped");
+
+  //Test Case 4: stopping returns the time left and no more signals come
+  ret = syssetitimer(31, 0, 0);
+  test_result &= assert_equal(1, ret >= 0 && ret <= 20, __func__, 4, "wrong time left");
+  syssleep(100);
+  test_result &= assert_equal(3, test_counter, __func__, 4, "stopped timer went off");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Test sysgettime
+ */
+void test_sysgettime( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  unsigned long long start, last, now;
+  int j, backwards = 0;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: the clock never goes backwards
+  last = sysgettime();
+  for( j = 0; j < 1000; j++ ) {
+    now = sysgettime();
+    if ( now < last ) backwards++;
+    last = now;
+  }
+  test_result &= assert_equal(0, backwards, __func__, 1, "clock went backwards");
+
+  //Test Case 2: the clock agrees with syssleep
+  start = sysgettime();
+  syssleep(100);
+  now = sysgettime();
+  test_result &= assert_equal(1, now - start >= 100000000ULL, __func__, 2, "woke before 100ms");
+  test_result &= assert_equal(1, now - start < 200000000ULL, __func__, 2, "slept over 200ms");
+
+  //Test Case 3: the clock is finer than a tick
+  start = sysgettime();
+  sysnanosleep(1000000);
+  now = sysgettime();
+  test_result &= assert_equal(1, now - start >= 1000000ULL, __func__, 3, "woke before 1ms");
+  test_result &= assert_equal(1, now - start < MILLISECONDS_TICK * 1000000ULL, __func__, 3, "not finer than a tick");
+
+  //Test Case 4: the kernel does not write through a bad pointer
+  j = syscall(SYS_GETTIME, NULL);
+  test_result &= assert_equal(-1, j, __func__, 4, "NULL pointer accepted");
+  j = syscall(SYS_GETTIME, (unsigned long long *) (641 * 1024));
+  test_result &= assert_equal(-1, j, __func__, 4, "address in hole accepted");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Yields until killed, so it is never running when a tick comes
+ */
+void yield_forever( void ) {
+  while ( 1 ) sysyield();
+}
+
+/*
+ * Finds pid in a process status table, -1 if it is not there
+ */
+static int ps_slot( processStatuses *ps, int procs, int pid ) {
+  int j;
+
+  for( j = 0; j <= procs; j++ ) {
+    if ( ps->pid[j] == pid ) return j;
+  }
+  return -1;
+}
+
+/*
+ * Test CPU times in sysgetcputimes
+ */
+void test_cpu_accounting( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  static processStatuses ps;
+  unsigned long long start;
+  unsigned long before;
+  int pid, procs, j;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: a process that always yields before a tick is charged
+  pid = syscreate(yield_forever, 4096);
+  syssleep(100);
+  procs = sysgetcputimes(&ps);
+  j = ps_slot(&ps, procs, pid);
+  test_result &= assert_equal(1, j >= 0, __func__, 1, "yielding process not listed");
+  test_result &= assert_equal(1, ps.userTime[j] > 0, __func__, 1, "no user time charged");
+  test_result &= assert_equal(1, ps.sysTime[j] > 0, __func__, 1, "no kernel time charged");
+  test_result &= assert_equal(ps.userTime[j] + ps.sysTime[j], ps.cpuTime[j], __func__, 1, "cpu time not user plus kernel");
+  syskillproc(pid);
+
+  //Test Case 2: 30ms of work is charged as about 30ms
+  procs = sysgetcputimes(&ps);
+  j = ps_slot(&ps, procs, sysgetpid());
+  before = ps.cpuTime[j];
+  start = sysgettime();
+  while ( sysgettime() - start < 30000000ULL );
+  procs = sysgetcputimes(&ps);
+  j = ps_slot(&ps, procs, sysgetpid());
+  test_result &= assert_equal(1, ps.cpuTime[j] - before >= 25000, __func__, 2, "work undercharged");
+  test_result &= assert_equal(1, ps.cpuTime[j] - before <= 40000, __func__, 2, "work overcharged");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Sets a timeout and never makes the call it is for
+ */
+void timeout_forever( void ) {
+  syssettimeout(30);
+  for(;;);
+}
+
+/*
+ * Waits on nap_pid, as the first call it makes
+ */
+void wait_nap( void ) {
+  waited = syswait(nap_pid);
+}
+
+
+/*
+ * Test syssettimeout
+ */
+void test_syssettimeout( void ) {
+
+  int test_result = 1;
+  char *str[500];
+  unsigned int input[10];
+  int pid, ret, fd;
+
+  sprintf( (char *)str, "\nRunning Tests: %s \n", __func__ );
+  sysputs( (char *)str );
+
+  //Test Case 1: syswait gives up when the timeout runs out
+  slept_long = 0;
+  pid = syscreate(nap_long, 1024);
+  syssettimeout(50);
+  ret = syswait(pid);
+  test_result &= assert_equal(TIMEOUT, ret, __func__, 1, "syswait did not time out");
+  test_result &= assert_equal(0, slept_long, __func__, 1, "timed out after the process ended");
+  ret = syswait(pid);
+  test_result &= assert_equal(0, ret, __func__, 1, "timeout was not used up");
+  test_result &= assert_equal(1, slept_long, __func__, 1, "second syswait returned early");
+
+  //Test Case 2: a wait that ends in time cancels the timer
+  pid = syscreate(nap_short, 1024);
+  syssettimeout(500);
+  ret = syswait(pid);
+  test_result &= assert_equal(0, ret, __func__, 2, "syswait timed out early");
+  ret = syssleep(600);
+  test_result &= assert_equal(0, ret, __func__, 2, "timer went off after the wait");
+
+  //Test Case 3: a call that does not block uses up the timeout
+  pid = syscreate(nap_long, 1024);
+  syssettimeout(30);
+  sysgetpid();
+  ret = syswait(pid);
+  test_result &= assert_equal(0, ret, __func__, 3, "timeout applied to a later call");
+
+  //Test Case 4: a keyboard read with nothing typed times out
+  fd = sysopen(0);
+  syssettimeout(50);
+  ret = sysread(fd, &input, 4);
+  test_result &= assert_equal(TIMEOUT, ret, __func__, 4, "sysread did not time out");
+  sysclose(fd);
+
+  //Test Case 5: a killed process's timeout is not left for its slot
+  pid = syscreate(timeout_forever, 1024);
+  sysyield();
+  syskill(pid, SIGKILL);
+  syswait(pid);
+  nap_pid = syscreate(nap_long, 1024);
+  waited = TIMEOUT;
+  pid = syscreate(wait_nap, 1024);
+  syswait(pid);
+  test_result &= assert_equal(0, waited, __func__, 5, "timeout carried into reused slot");
+
+  sprintf( (char *)str, "%s %s\n", __func__, (test_result? "TEST PASSED" : "TEST FAILED"));
+  sysputs( (char *)str );
+}
+
+
+/*
+ * Run all timer tests
+ */
+void run_timer_tests( void ) {
+  int pid;
+
+  pid = syscreate(test_syssleep, 8192);
+  syswait(pid);
+
+  pid = syscreate(test_sysnanosleep, 8192);
+  syswait(pid);
+
+  pid = syscreate(test_syssettimerslack, 8192);
+  syswait(pid);
+
+  pid = syscreate(test_syssleepuntil, 8192);
+  syswait(pid);
+
+  pid = syscreate(test_syssetitimer, 8192);
+  syswait(pid);
+
+  pid = syscreate(test_sysgettime, 8192);
+  syswait(pid);
+
+  pid = syscreate(test_cpu_accounting, 8192);
+  syswait(pid);
+
+  pid = syscreate(test_syssettimeout, 8192);
+  syswait(pid);
+}
+
+
 /* ================================================================ */
 /*                         Original Tests                           */
 /* ================================================================ */
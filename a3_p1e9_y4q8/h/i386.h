@@ -50,6 +50,44 @@ struct sd {
 
 #define	SDT_INTG	14	/* Interrupt Gate	*/
 
+/* Segment descriptor type of an available 32 bit TSS (sd_perm/sd_iscode) */
+#define	SDT_TSS		9
+
+/* Task State Segment, the registers of a task saved by the processor */
+struct tss {
+	unsigned short	link, rsvd0;	/* TSS of the task that called this one */
+	unsigned long	esp0;
+	unsigned short	ss0, rsvd1;
+	unsigned long	esp1;
+	unsigned short	ss1, rsvd2;
+	unsigned long	esp2;
+	unsigned short	ss2, rsvd3;
+	unsigned long	cr3;
+	unsigned long	eip;
+	unsigned long	eflags;
+	unsigned long	eax, ecx, edx, ebx;
+	unsigned long	esp, ebp, esi, edi;
+	unsigned short	es, rsvd4;
+	unsigned short	cs, rsvd5;
+	unsigned short	ss, rsvd6;
+	unsigned short	ds, rsvd7;
+	unsigned short	fs, rsvd8;
+	unsigned short	gs, rsvd9;
+	unsigned short	ldt, rsvd10;
+	unsigned short	trap;
+	unsigned short	iomap;		/* offset of the I/O permission map */
+};
+
+/* Page directory and page table entries */
+#define	PG_PRESENT	0x001
+#define	PG_WRITE	0x002
+#define	PG_FRAME	(~(NBPG - 1))
+#define	PG_ENTRIES	1024
+#define	PG_SPAN		(PG_ENTRIES * NBPG)	/* bytes mapped by one table */
+
+/* Page fault error code bits */
+#define	PF_PROTECT	0x001	/* page was present, access not allowed */
+
 /* Segment Table Register */
 struct segtr {
 	unsigned int	len : 16;
@@ -72,6 +110,32 @@ struct segtr {
 	   }						\
 }
 
+/* BIOS memory map left by boot/setup.S at INITSEG:0x1000 */
+#define	E820_SIG	0x534d4150	/* `SMAP' */
+#define	E820_MAX	32
+#define	E820_RAM	1		/* entry type of usable memory */
+
+struct e820entry {
+	unsigned long	base_lo, base_hi;
+	unsigned long	len_lo, len_hi;
+	unsigned long	type;
+};
+
+struct e820map {
+	unsigned long	sig;		/* E820_SIG once the map is complete */
+	unsigned short	nr;
+	unsigned short	pad;
+	struct e820entry map[E820_MAX];
+};
+
+#define	E820_MAP	((struct e820map *) 0x91000)
+
+/* Extended memory in KB above 1 MB, from int 0x15 ah=0x88 */
+#define	EXT_MEM_K	(*(unsigned short *) 0x90002)
+
+/* Memory above this is ignored, leaving address space for process stacks */
+#define	MAX_PHYS	0x80000000
+
 #define HOLESIZE        (600)
 #define HOLESTART       (640 * 1024)
 #define HOLEEND         ((1024 + HOLESIZE) * 1024)
@@ -109,10 +173,19 @@ struct segtr {
 #define         TIMER_MSB       0x20    /* r/w counter MSB */
 #define         TIMER_16BIT     0x30    /* r/w counter 16 bits, LSB first */
 #define         TIMER_BCD       0x01    /* count in BCD */
+#define         TIMER_READBACK  0xc0    /* read-back command */
+#define         TIMER_RB_COUNT  0x20    /* ... don't latch the count */
+#define         TIMER_RB_STATUS 0x10    /* ... don't latch the status */
+#define         TIMER_RB_CTR0   0x02    /* ... of counter 0 */
+#define         TIMER_STAT_OUT  0x80    /* status: output pin is high */
 
 
 /* Some helpful prototypes */
 void initPIT( int divisor );
+void pit_oneshot( unsigned int count );
+unsigned int pit_read( int *expired );
+int has_tsc( void );
+unsigned long long rdtsc( void );
 void end_of_intr( void );
 void enable_irq( unsigned int irq, int disable );
 
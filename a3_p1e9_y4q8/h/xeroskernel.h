@@ -53,6 +53,25 @@ void           outb(unsigned int, unsigned char);
 /* Some constants involved with process creation and managment */
 
 #define MAX_SIGNALS     32
+   /* Most signals from syssigqueue a process can have waiting */
+#define SIGQUEUE_MAX    16
+   /* How syssigprocmask changes the blocked signals */
+#define SIG_BLOCK       0
+#define SIG_UNBLOCK     1
+#define SIG_SETMASK     2
+   /* Signals with a default action when there is no handler; the rest */
+   /* are ignored. SIGKILL and SIGSTOP cannot be handled or blocked.   */
+#define SIGKILL         9
+#define SIGTERM         15
+#define SIGCONT         18
+#define SIGSTOP         19
+   /* Sent to a process's creator when it exits, unless changed with */
+   /* syssetchildsig; ignored when there is no handler                */
+#define SIGCHLD         17
+   /* Exited children a process can have waiting for syswaitany */
+#define EXITED_MAX      16
+   /* Smallest alternate signal stack syssigaltstack takes */
+#define SIGSTACK_MIN    1024
    /* Maximum number of processes */
 #define MAX_PROC        64
    /* Kernel trap number          */
@@ -65,8 +84,25 @@ void           outb(unsigned int, unsigned char);
 #define KEYBOARD_INT      (KEYBOARD_IRQ + 32)
    /* Minimum size of a stack when a process is created */
 #define PROC_STACK      (4096 * 4)
+   /* Byte pattern unused stack memory is filled with */
+#define STACK_FILL      0xA5
+   /* Virtual space reserved for each process's stack, guard page included */
+#define STACK_VSIZE     (4096 * 64)
+   /* Headroom kept above a measured stack high-water mark */
+#define STACK_SLACK     512
+   /* Smallest stack handed out when right-sizing */
+#define STACK_MIN       1024
+   /* Honour stack requests below PROC_STACK once they are shown safe */
+#define STACK_RIGHTSIZE FALSE
+   /* Number of size classes in a process heap arena */
+#define ARENA_CLASSES   8
+   /* Default memory limit of a group of processes, in bytes */
+#define MEM_QUOTA       (1024 * 1024)
    /* Number of milliseconds in a tick */
 #define MILLISECONDS_TICK 10
+   /* Default nanoseconds a process's sleeps may end late by, so nearby */
+   /* wakeups can be handled together                                  */
+#define TIMER_SLACK     50000
 
 /* Constants to track states that a process is in */
 #define STATE_STOPPED   0
@@ -75,6 +111,8 @@ void           outb(unsigned int, unsigned char);
 #define STATE_RUNNING   23
 #define STATE_WAIT      24
 #define STATE_READ      25
+#define STATE_PAUSED    26
+#define STATE_SIGWAIT   27
 
 /* System call identifiers */
 #define SYS_STOP        10
@@ -96,15 +134,65 @@ void           outb(unsigned int, unsigned char);
 #define SYS_READ        185
 #define SYS_IOCTL       186
 #define SYS_KEYBD       187
+#define SYS_MALLOC      188
+#define SYS_FREE        189
+#define SYS_MEMINFO     190
+#define SYS_MEMTRACE    191
+#define SYS_MEMLIMIT    192
+#define SYS_NANOSLEEP   193
+#define SYS_TIMERSLACK  194
+#define SYS_SLEEPUNTIL  195
+#define SYS_GETTICKS    196
+#define SYS_SETITIMER   197
+#define SYS_GETTIME     198
+#define SYS_TIMEOUT     199
+#define SYS_SIGMASK     200
+#define SYS_SIGQUEUE    201
+#define SYS_SIGSTACK    202
+#define SYS_SIGWAIT     203
+#define SYS_WAITANY     204
+#define SYS_CHILDSIG    205
 
 /* Device stuff */
 #define MAX_PROC_DEVICES 4
 #define MAX_KERN_DEVICES 2
 #define NULL_DEVICE     -1
+   /* ioctl every device takes: signal the caller when there is data */
+   /* to read, or stop if the signal is -1                            */
+#define DEV_NOTIFY      60
 
 typedef struct struct_pcb pcb;
 typedef struct struct_devsw devsw;
 
+/* A typedef for the signature of the function passed to syscreate */
+typedef void    (*funcptr)(void);
+
+/* A function to call when a kernel timer goes off */
+typedef void    (*timerfn)(void *arg);
+
+/* A kernel timer, see timer.c */
+typedef struct struct_ktimer ktimer;
+struct struct_ktimer {
+  ktimer       *next;    /* Next timer in the wheel slot              */
+  ktimer       *prev;    /* Previous timer in the wheel slot          */
+  ktimer      **list;    /* Head of the slot, NULL if not running     */
+  unsigned long expires; /* Tick the timer goes off at                */
+  timerfn       fn;      /* Called with arg when it goes off          */
+  void         *arg;
+};
+
+/* A high resolution timer, see hrtimer.c */
+typedef struct struct_hrtimer hrtimer;
+struct struct_hrtimer {
+  hrtimer      *next;    /* Next timer to go off                      */
+  hrtimer      *prev;    /* Previous timer to go off                  */
+  unsigned long long deadline; /* hrclock time it goes off at         */
+  unsigned long slack;   /* ... or up to this many ns after           */
+  timerfn       fn;      /* Called with arg when it goes off          */
+  void         *arg;
+  Bool          queued;  /* Running                                   */
+};
+
 struct struct_devsw {
   char        *dev_name;
   int          dev_num;
@@ -114,6 +202,8 @@ struct struct_devsw {
   int        (*dev_write)( pcb *proc, devsw * dev, void *buf, int buflen );
   int        (*dev_ioctl)( pcb *proc, devsw * dev, unsigned long command, va_list varargs );
   void        *dev_state;
+  int          notify_pid;  /* Process to signal when data comes in, or 0 */
+  int          notify_sig;  /* ... and the signal to send it              */
 };
 
 /* Structure to track the information associated with a single process */
@@ -123,28 +213,114 @@ struct struct_pcb {
   pcb         *prev;   /* Previous proccess in list, if applicable*/
   int          state;  /* State the process is in, see above      */
   unsigned int pid;    /* The process's ID                        */
+  int          ppid;   /* ID of the process that created it       */
   int          ret;    /* Return value of system call             */
                        /* if process interrupted because of system*/
                        /* call                                    */
   long         args;
   void        *buffer;                    /* Buffer for syscalls              */
   int          bufferlen;                 /* Length of buffer                 */
-  int          sleepdiff;
-  long         cpuTime;                   /* CPU time  consumed               */
+  ktimer       sleepTimer;                /* Wakes the process from syssleep  */
+  hrtimer      hrSleep;                   /* ... and from sysnanosleep        */
+  unsigned int timerSlack;                /* ns either may wake late by       */
+  ktimer       itimer;                    /* Interval timer from syssetitimer */
+  int          itimerSig;                 /* Signal it posts                  */
+  unsigned long itimerWhen;               /* Tick it is next due              */
+  unsigned long itimerInterval;           /* Ticks between, 0 for one shot    */
+  unsigned long timeout;                  /* Ticks the next blocking call may */
+                                          /* wait, 0 for ever                 */
+  ktimer       blockTimer;                /* Runs out that wait               */
+  unsigned long userTime;                 /* us running its own code          */
+  unsigned long sysTime;                  /* us in the kernel on its behalf   */
+  unsigned int userNs;                    /* ns of each not yet a whole us    */
+  unsigned int sysNs;
   void        *sig_handlers[MAX_SIGNALS]; /* Table containing signal handlers */
   unsigned int signals;                   /* A bit flag for the 32 signals    */
+  unsigned int sigMask;                   /* Signals blocked, left pending    */
+  int          paused;                    /* Stopped by SIGSTOP until SIGCONT */
+  void        *sigStack;                  /* Stack handlers run on, or NULL   */
+  int          sigStackSize;              /* ... and its size in bytes        */
+  int          sigRet;                    /* ret of the call handlers cut off */
+  int          sigQueued[SIGQUEUE_MAX];   /* Signals from syssigqueue, oldest */
+  int          sigValues[SIGQUEUE_MAX];   /* first, and the value of each     */
+  int          sigCount;                  /* Entries in sigQueued             */
+  unsigned int sigWaitMask;               /* Signals syssigwait is waiting on */
+  int         *sigWaitSig;                /* Where to put the one it gets,    */
+  int         *sigWaitValue;              /* and its value                    */
   int          processing;                /* A flag to indicate currently processing a signal */
+  int          exitStatus;                /* From sysexit, or -signal if killed */
+  int          childSig;                  /* Signal sent when a child exits   */
+  int          exitedPids[EXITED_MAX];    /* Children that have exited, not   */
+  int          exitedStatus[EXITED_MAX];  /* yet reaped, oldest first         */
+  int          exitedCount;               /* Entries in exitedPids            */
+  int          exitedLost;                /* Children exited with no room     */
   pcb         *waiting_proc;              /* The process this is waiting on   */
   pcb         *wait_head;                 /* Head of waiting queue            */
   pcb         *wait_tail;                 /* Tail of waiting queue            */
   devsw       *fd_tab[MAX_PROC_DEVICES];  /* Device fd table for process      */
+  void        *stack;                     /* Lowest address of the stack      */
+  size_t       stackSize;                 /* Size of the stack in bytes       */
+  size_t       stackHWM;                  /* Stack high-water mark at exit    */
+  funcptr      entry;                     /* Function the process started in  */
+  void        *arena;                     /* Chunks of the process heap arena */
+  void        *arena_free[ARENA_CLASSES]; /* Free objects of each size class  */
+  int          memGroup;                  /* Group memory is charged to       */
+  unsigned long memUsed;                  /* Bytes charged by this process    */
+};
+
+/* A signal handler for sigtramp to run and the value for it */
+typedef struct struct_sigentry sigentry;
+struct struct_sigentry {
+  void        *handler;
+  int          value;
 };
 
 typedef struct struct_ps processStatuses;
 struct struct_ps {
   int  pid[MAX_PROC];      // The process ID
   int  status[MAX_PROC];   // The process status
-  long  cpuTime[MAX_PROC]; // CPU time used in milliseconds
+  long  cpuTime[MAX_PROC]; // CPU time used in microseconds
+  unsigned long userTime[MAX_PROC]; // ... running its own code
+  unsigned long sysTime[MAX_PROC];  // ... in the kernel on its behalf
+  int  stackSize[MAX_PROC]; // Size of the process stack in bytes
+  int  stackUsed[MAX_PROC]; // Bytes of stack touched so far
+  unsigned long memUsed[MAX_PROC];   // Bytes of memory charged to the process
+  unsigned long groupUsed[MAX_PROC]; // Bytes charged to its group
+  unsigned long memLimit[MAX_PROC];  // Limit of its group
+};
+
+typedef struct struct_meminfo meminfo;
+struct struct_meminfo {
+  unsigned long lowTotal;               // Bytes managed below HOLESTART
+  unsigned long lowFree;                // Bytes free below HOLESTART
+  unsigned long highTotal;              // Bytes managed above HOLEEND
+  unsigned long highFree;               // Bytes free above HOLEEND
+  unsigned long largestFree;            // Largest single free block
+  int  fragments;                       // Number of free blocks
+  int  failures;                        // kmalloc calls that failed
+  int  fragFailures;                    // ... with enough memory free in total
+  int  owners;                          // Entries used in the tables below
+  int  pid[MAX_PROC + 1];               // Owning process, -1 for the kernel
+  int  allocs[MAX_PROC + 1];            // Number of blocks allocated
+  unsigned long bytes[MAX_PROC + 1];    // Bytes allocated, including headers
+};
+
+typedef struct struct_memsite memsite;
+struct struct_memsite {
+  void *caller;                         // Return address of the allocating call
+  int  pid;                             // Owning process, -1 for the kernel
+  int  allocs;                          // Live blocks allocated there
+  unsigned long bytes;                  // Bytes in them, not counting headers
+  unsigned long oldest;                 // Tick the oldest one was allocated at
+};
+
+/* A range of usable physical memory found at boot */
+#define MAX_PHYS_RANGES 16
+
+typedef struct struct_memrange memrange;
+struct struct_memrange {
+  unsigned long start;                  // First byte of the range
+  unsigned long end;                    // First byte past the range
 };
 
 /* Kernel device table */
@@ -153,6 +329,9 @@ devsw dev_tab[MAX_KERN_DEVICES];
 /* The actual space is set aside in create.c */
 extern pcb     proctab[MAX_PROC];
 
+/* Timer ticks since boot, counted in sleep.c */
+extern unsigned long ticks;
+
 #pragma pack(1)
 
 /* What the set of pushed registers looks like on the stack */
@@ -176,12 +355,21 @@ typedef struct context_frame {
 /* processes to call these.                                     */
 
 void     kfree(void *ptr);
-void     kmeminit( void );
+void     kmeminit( memrange *ranges, int nranges );
 void     *kmalloc( size_t );
-
-
-/* A typedef for the signature of the function passed to syscreate */
-typedef void    (*funcptr)(void);
+void     *kmemalign( size_t align, size_t size );
+void     *krealloc( void *ptr, size_t size );
+void     kmemowner( void *ptr, int pid );
+int      getmeminfo( pcb *p, meminfo *mi );
+int      getmemtrace( pcb *p, memsite *sites, int max );
+int      kmemcheck( int pid );
+void     kmemgroup( pcb *p );
+int      kmemjoin( pcb *p, pcb *leader );
+void     kmemleave( pcb *p );
+int      kmemcharge( pcb *p, unsigned long bytes, Bool force );
+void     kmemuncharge( pcb *p, unsigned long bytes );
+void     kmemusage( pcb *p, unsigned long *groupUsed, unsigned long *limit );
+int      setmemlimit( pcb *caller, int pid, unsigned long limit );
 
 
 /* Internal functions for the kernel, applications must never  */
@@ -197,41 +385,96 @@ void     contextinit( void );
 int      contextswitch( pcb *p );
 int      create( funcptr fp, size_t stack );
 void     set_evec(unsigned int xnum, unsigned long handler);
+void     set_taskgate(unsigned int xnum, unsigned int selector);
 void     printCF (void * stack);  /* print the call frame */
 int      syscall(int call, ...);  /* Used in the system call stub */
 void     sleep(pcb *, unsigned int);
-int      removeFromSleep(pcb * p);
+void     nanosleep(pcb *p, unsigned int ns);
+void     sleepuntil(pcb *p, unsigned long when);
+unsigned int removeFromSleep(pcb * p);
+void     removeFromReady(pcb * p);
 void     stop(pcb * p);
+void     terminate(pcb *p, int sig_no);
+void     suspend(pcb *p);
+void     resume(pcb *p);
 void     tick( void );
+void     timer_add( ktimer *t, unsigned long delay, unsigned long slack,
+                    timerfn fn, void *arg );
+void     timer_add_at( ktimer *t, unsigned long when, unsigned long slack,
+                       timerfn fn, void *arg );
+int      timer_cancel( ktimer *t );
+void     timer_tick( void );
+void     hrtimer_init( void );
+unsigned long long hrclock( void );
+unsigned long long gettime( void );
+void     hrtimer_add( hrtimer *t, unsigned long long deadline,
+                      unsigned long slack, timerfn fn, void *arg );
+int      hrtimer_cancel( hrtimer *t );
+int      hrtimer_interrupt( void );
 int      getCPUtimes(pcb * p, processStatuses *ps);
 pcb     *findPCB( int pid );
+size_t   stack_used( pcb *p );
+void     stack_exit( pcb *p );
 void     keyboard_int_handler( void );
+void    *arena_alloc( pcb *proc, int size );
+int      arena_free( pcb *proc, void *ptr );
+void     arena_release( pcb *proc );
+void     paging_init( void );
+void    *stack_reserve( pcb *p, size_t size );
+void     stack_release( pcb *p );
+Bool     page_mapped( void *addr );
+Bool     user_range_ok( pcb *p, void *addr, unsigned long len );
+Bool     stack_strayed( void );
 
 /* Function prototypes for system calls as called by the application */
 int          syscreate( funcptr fp, size_t stack );
 void         sysyield( void );
 void         sysstop( void );
+void         sysexit( int status );
 unsigned int sysgetpid( void );
 unsigned int syssleep(unsigned int);
+unsigned int sysnanosleep(unsigned int ns);
+unsigned int syssettimerslack(unsigned int ns);
+unsigned int syssleepuntil(unsigned long tick);
+unsigned long sysgetticks(void);
+int          syssetitimer(int signal, unsigned int initial, unsigned int interval);
+unsigned long long sysgettime(void);
+int          syssettimeout(unsigned int ms);
 void         sysputs(char *str);
 int          syskill(int pid, int signalNumber);
 int          syskillproc(int pid);
 int          sysgetcputimes(processStatuses *ps);
 int          syssighandler(int signal, void (*newHandler)(void *), void (** oldHandler)(void *));
 void         syssigreturn(void *old_sp);
+int          syssigprocmask(int how, unsigned int mask, unsigned int *oldmask);
+int          syssigqueue(int pid, int signalNumber, int value);
+int          syssigaltstack(void *stack, int size);
+int          syssigwait(unsigned int mask, int *sig, int *value);
 int          syswait(int PID);
+int          syswaitany(int *pid, int *status);
+int          syssetchildsig(int signal);
 int          sysopen(int device_no);
 int          sysclose(int fd);
 int          syswrite(int fd, void *buf, int buflen);
 int          sysread(int fd, void *buf, int buflen);
 int          sysioctl(int fd, unsigned long command, ...);
+void        *sysmalloc(int size);
+int          sysfree(void *ptr);
+int          sysmeminfo(meminfo *mi);
+int          sysmemtrace(memsite *sites, int max);
+int          syssetmemlimit(int pid, unsigned long limit);
 
 /* signal.c functions */
 int          signal(int pid, int sig_no);
+int          sigqueue(int pid, int sig_no, int value);
+int          sigprocmask(pcb *proc, int how, unsigned int mask, unsigned int *oldmask);
+int          sigaltstack(pcb *proc, void *stack, int size);
+Bool         sigwait(pcb *proc, unsigned int mask, int *sig, int *value);
 int          sighandler(pcb *proc, int signal, void (*newHandler)(void *), void (** oldHandler)(void *));
-void         sigtramp(void (* handler)(void *), void *cntx);
+void         sigtramp(sigentry *list, int n, void *cntx);
 void         sigreturn(pcb *proc, void *old_sp);
-void         setup_sigtramp(pcb *proc);
+int          setitimer(pcb *proc, int sig_no, unsigned int initial, unsigned int interval);
+int          setup_sigtramp(pcb *proc);
 
 /* The initial process that the system creates and schedules */
 void         root( void );
@@ -243,9 +486,9 @@ void         init( void);
 
 /* command programs */
 void         shell( void );
-void         alarm( void );
 void         alarm_handler( void *cntx );
 void         t( void );
+void         sleepbench( void );
 
 
 /* di_calls */
@@ -254,6 +497,7 @@ Bool         di_close(pcb *proc, int fd);
 Bool         di_read(pcb *proc, int fd, void *buf, int buflen);
 Bool         di_write(pcb *proc, int fd, void *buf, int buflen);
 Bool         di_ioctl(pcb *proc, int fd, unsigned long command, va_list varargs);
+void         dev_notify(devsw *dev);
 void         devices_init( void );
 
 
@@ -261,9 +505,36 @@ void         devices_init( void );
 void         test_syssighandler( void );
 void         test_syskill( void );
 void         test_signal_priority( void );
+void         test_syssigprocmask( void );
+void         test_syssigqueue( void );
+void         test_default_actions( void );
+void         test_syssigaltstack( void );
+void         test_syssigwait( void );
+void         test_syswaitany( void );
+void         count_forever( void );
+void         nap_long( void );
 void         test_syswait( void );
 void         run_signal_tests( void );
 void         run_device_tests( void );
+void         test_stack_usage( void );
+void         test_stack_guard( void );
+void         test_sysmalloc( void );
+void         test_sysmeminfo( void );
+void         test_sysmemtrace( void );
+void         test_syssetmemlimit( void );
+void         run_memory_tests( void );
+void         test_syssleep( void );
+void         test_sysnanosleep( void );
+void         test_syssettimerslack( void );
+void         test_syssleepuntil( void );
+void         test_syssetitimer( void );
+void         test_sysgettime( void );
+void         test_cpu_accounting( void );
+void         yield_forever( void );
+void         timeout_forever( void );
+void         wait_nap( void );
+void         test_syssettimeout( void );
+void         run_timer_tests( void );
 
 
 void           set_evec(unsigned int xnum, unsigned long handler);